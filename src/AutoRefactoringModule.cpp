@@ -3,20 +3,78 @@
 #include "../ClangTidyModuleRegistry.h"
 #include "CallExprInIfChecker.h"
 #include "CommaInIfChecker.h"
+#include "FunctionAnalysisManager.h"
 #include "GoToReturnChecker.h"
 #include "IfElseReturnChecker.h"
+#include "llvm/ADT/DenseMap.h"
+#include <mutex>
 
 namespace clang::tidy {
 namespace autorefactorings {
 
+/// The analysis managers of the contexts the checks are created for. The
+/// checks of one context share a manager, the checks of different contexts,
+/// e.g. of TUs built on different threads, never do. A manager lives as
+/// long as the checks holding it.
+class ContextAnalyses {
+public:
+  std::shared_ptr<FunctionAnalysisManager> get(ClangTidyContext &Context) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    // The entries of the contexts whose checks are all gone are dropped.
+    for (auto Iter = Managers.begin(); Iter != Managers.end();) {
+      auto Current = Iter++;
+      if (Current->second.expired()) {
+        Managers.erase(Current);
+      }
+    }
+
+    const auto &CheckOptions = Context.getOptions().CheckOptions;
+    if (auto Manager = Managers.lookup(&Context).lock()) {
+      // The checks of the next TU of the context may see other options.
+      Manager->readOptions(CheckOptions);
+      return Manager;
+    }
+    auto Manager = std::make_shared<FunctionAnalysisManager>(CheckOptions);
+    Managers[&Context] = Manager;
+    return Manager;
+  }
+
+private:
+  std::mutex Mutex;
+  llvm::DenseMap<const ClangTidyContext *,
+                 std::weak_ptr<FunctionAnalysisManager>>
+      Managers;
+};
+
 /// A module containing checks of the AutoRefactoringModule
 class AutoRefactoringModule : public ClangTidyModule {
 public:
   void addCheckFactories(ClangTidyCheckFactories &CheckFactories) override {
-    CheckFactories.registerCheck<IfElseReturnChecker>("if-else-refactor");
-    CheckFactories.registerCheck<CommaInIfChecker>("if-comma-refactor");
-    CheckFactories.registerCheck<CallExpInIfChecker>("if-call-refactor");
-    CheckFactories.registerCheck<GoToReturnChecker>("goto-return-checker");
+    // The checks of a context share one cache of function analyses, so that
+    // the CFG and the traversal of a function body are done only once.
+    auto Analyses = std::make_shared<ContextAnalyses>();
+
+    registerSharedCheck<IfElseReturnChecker>(CheckFactories, "if-else-refactor",
+                                             Analyses);
+    registerSharedCheck<CommaInIfChecker>(CheckFactories, "if-comma-refactor",
+                                          Analyses);
+    registerSharedCheck<CallExpInIfChecker>(CheckFactories, "if-call-refactor",
+                                            Analyses);
+    registerSharedCheck<GoToReturnChecker>(CheckFactories,
+                                           "goto-return-checker", Analyses);
+  }
+
+private:
+  template <typename CheckType>
+  static void
+  registerSharedCheck(ClangTidyCheckFactories &CheckFactories,
+                      StringRef CheckName,
+                      std::shared_ptr<ContextAnalyses> Analyses) {
+    CheckFactories.registerCheckFactory(
+        CheckName, [Analyses](StringRef Name, ClangTidyContext *Context) {
+          return std::make_unique<CheckType>(Name, Context,
+                                             Analyses->get(*Context));
+        });
   }
 };
 
@@ -1,4 +1,5 @@
 #include "AutoRefactoringModuleUtils.h"
+#include "FunctionAnalysisManager.h"
 #include "clang/Analysis/CFGStmtMap.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Lex/Preprocessor.h"
@@ -78,22 +79,16 @@ bool Utils::isOnlyIterruptionBlock(const clang::CFGBlock *Block,
          Block->hasNoReturnElement();
 }
 
-int Utils::getTokenLenght(SourceLocation Loc,
-                          const clang::ASTContext &Context) {
-  return clang::Lexer::MeasureTokenLength(Loc, Context.getSourceManager(),
-                                          Context.getLangOpts());
-};
-
 llvm::StringRef Utils::getSourceText(const clang::SourceRange &Range,
                                      const clang::SourceManager *Manager,
-                                     const clang::ASTContext *Context) {
-  const auto LangOptions = Context->getLangOpts();
+                                     const clang::ASTContext *Context,
+                                     FunctionAnalysisManager &Analyses) {
   const auto Start = Manager->getSpellingLoc(Range.getBegin());
-  const auto End = clang::Lexer::getLocForEndOfToken(
-      Manager->getSpellingLoc(Range.getEnd()), 0, *Manager, LangOptions);
-  return clang::Lexer::getSourceText(
+  const auto End = Analyses.getLocForEndOfToken(
+      Manager->getSpellingLoc(Range.getEnd()), *Context);
+  return Analyses.getSourceText(
       clang::CharSourceRange::getTokenRange(clang::SourceRange{Start, End}),
-      *Manager, LangOptions);
+      *Context);
 }
 
 /// Get the latest Stmt in scope if it is Compound Stmt
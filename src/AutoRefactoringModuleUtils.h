@@ -18,6 +18,8 @@ class StringRef;
 
 namespace clang::tidy::autorefactorings {
 
+class FunctionAnalysisManager;
+
 class Utils {
 
 public:
@@ -39,14 +41,12 @@ public:
   static bool isOnlyIterruptionBlock(const CFGBlock *Block, const CFG &Cfg,
                                      const SourceManager *Manager);
 
-  /// This function is designed to get the length of the token to handle offsets
-  /// correctly.
-  static int getTokenLenght(SourceLocation Loc, const ASTContext &Context);
-
-  /// Get the source text using CharRange and SourceManager
+  /// Get the source text using CharRange and SourceManager, the tokens are
+  /// taken from the token index of the file.
   static llvm::StringRef getSourceText(const SourceRange &Range,
                                        const SourceManager *Manager,
-                                       const ASTContext *Context);
+                                       const ASTContext *Context,
+                                       FunctionAnalysisManager &Analyses);
 
   /// Get the latest Stmt in scope if it is Compound Stmt
   static const Stmt *getLastStmt(const Stmt *CurrentStmt);
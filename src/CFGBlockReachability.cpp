@@ -0,0 +1,63 @@
+#include "CFGBlockReachability.h"
+#include "clang/Analysis/Analyses/CFGReachabilityAnalysis.h"
+#include "clang/Analysis/CFG.h"
+
+using namespace clang;
+using namespace clang::tidy::autorefactorings;
+
+CFGBlockReachability::CFGBlockReachability(const CFG &Cfg,
+                                           unsigned MaxDenseBlocks) {
+  auto NumBlocks = Cfg.getNumBlockIDs();
+  if (NumBlocks > MaxDenseBlocks) {
+    LazyReachability =
+        std::make_unique<CFGReverseBlockReachabilityAnalysis>(Cfg);
+    return;
+  }
+
+  // The edges are taken from the predecessor lists, like the lazy analysis
+  // does, so pruned edges are ignored in the same way.
+  SmallVector<SmallVector<unsigned, 2>, 0> Successors(NumBlocks);
+  for (const auto *Block : Cfg) {
+    for (const CFGBlock *Pred : Block->preds()) {
+      if (Pred) {
+        Successors[Pred->getBlockID()].push_back(Block->getBlockID());
+      }
+    }
+  }
+
+  // Row |= {Succ} | Matrix[Succ] until nothing changes. The CFG is built
+  // backwards, so successors mostly have smaller IDs and visiting the blocks
+  // in the order of IDs converges in a few passes.
+  Matrix.assign(NumBlocks, llvm::BitVector(NumBlocks));
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (unsigned ID = 0; ID < NumBlocks; ++ID) {
+      auto &Row = Matrix[ID];
+      for (auto Succ : Successors[ID]) {
+        if (!Row.test(Succ)) {
+          Row.set(Succ);
+          Changed = true;
+        }
+        if (Succ != ID && Matrix[Succ].test(Row)) {
+          Row |= Matrix[Succ];
+          Changed = true;
+        }
+      }
+    }
+  }
+}
+
+CFGBlockReachability::~CFGBlockReachability() = default;
+
+bool CFGBlockReachability::isReachable(const CFGBlock *Src,
+                                       const CFGBlock *Dst) {
+  if (LazyReachability) {
+    return LazyReachability->isReachable(Src, Dst);
+  }
+  // The lazy analysis never reports a block as reachable from itself
+  if (Src == Dst) {
+    return false;
+  }
+  return Matrix[Src->getBlockID()].test(Dst->getBlockID());
+}
@@ -0,0 +1,38 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_CFGBLOCKREACHABILITY_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_CFGBLOCKREACHABILITY_H
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include <memory>
+
+namespace clang {
+class CFG;
+class CFGBlock;
+class CFGReverseBlockReachabilityAnalysis;
+} // namespace clang
+
+namespace clang::tidy::autorefactorings {
+
+/// Answers whether a CFG block is reachable from another one with the same
+/// results as CFGReverseBlockReachabilityAnalysis. For CFGs with at most
+/// MaxDenseBlocks blocks the transitive closure is computed at once as a bit
+/// matrix, so every query is a single bit test. Larger CFGs fall back to the
+/// lazy analysis, which computes the reachability of one destination at a
+/// time.
+class CFGBlockReachability {
+public:
+  CFGBlockReachability(const CFG &Cfg, unsigned MaxDenseBlocks);
+  ~CFGBlockReachability();
+
+  /// Whether Dst is reachable from Src by a non-empty path.
+  bool isReachable(const CFGBlock *Src, const CFGBlock *Dst);
+
+private:
+  // Blocks reachable from every block, indexed by the block ID.
+  llvm::SmallVector<llvm::BitVector, 0> Matrix;
+  std::unique_ptr<CFGReverseBlockReachabilityAnalysis> LazyReachability;
+};
+
+}; // namespace clang::tidy::autorefactorings
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_CFGBLOCKREACHABILITY_H
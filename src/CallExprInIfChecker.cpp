@@ -1,20 +1,106 @@
 #include "CallExprInIfChecker.h"
+#include "IfChainFixBuilder.h"
 #include "clang/Lex/Preprocessor.h"
-#include "llvm/Support/Regex.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <algorithm>
 
+using namespace clang;
 using namespace clang::ast_matchers;
 using namespace clang::tidy::autorefactorings;
 
 CallExpInIfChecker::CallExpInIfChecker(StringRef Name,
                                        ClangTidyContext *Context)
-    : ClangTidyCheck(Name, Context), UseAuto(Options.get("UseAuto", false)),
+    : CallExpInIfChecker(Name, Context,
+                         std::make_shared<FunctionAnalysisManager>(
+                             Context->getOptions().CheckOptions)) {}
+
+CallExpInIfChecker::CallExpInIfChecker(
+    StringRef Name, ClangTidyContext *Context,
+    std::shared_ptr<FunctionAnalysisManager> Analyses)
+    : ClangTidyCheck(Name, Context), Analyses(std::move(Analyses)),
+      UseAuto(Options.get("UseAuto", false)),
       UseDeclRefExpr(Options.get("UseDeclRefExpr", true)),
       UseAllCallExpr(Options.get("UseAllCallExpr", true)),
       FromSystemCHeader(Options.get("FromSystemCHeader", false)),
       VariablePrefix(Options.get("VariablePrefix", "var")),
       Pattern(Options.get("Filter", ".*")),
       IgnorePattern(Options.get("IgnoreFilter", "")),
-      IgnoreReturnTypePattern(Options.get("IgnoreReturnTypePattern", "")) {}
+      IgnoreReturnTypePattern(Options.get("IgnoreReturnTypePattern", "")),
+      FilterFile(Options.get("FilterFile", "")),
+      IgnoreFilterFile(Options.get("IgnoreFilterFile", "")),
+      FilterRegex(Pattern), IgnoreRegex(IgnorePattern),
+      IgnoreReturnTypeRegex(IgnoreReturnTypePattern) {
+  checkPattern("Filter", Pattern, FilterRegex);
+  checkPattern("IgnoreFilter", IgnorePattern, IgnoreRegex);
+  checkPattern("IgnoreReturnTypePattern", IgnoreReturnTypePattern,
+               IgnoreReturnTypeRegex);
+  if (!FilterFile.empty()) {
+    loadNameList(FilterFile, FilterNames);
+  }
+  if (!IgnoreFilterFile.empty()) {
+    loadNameList(IgnoreFilterFile, IgnoreNames);
+  }
+}
+
+void CallExpInIfChecker::loadNameList(StringRef Path,
+                                      llvm::StringSet<> &Names) {
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    configurationDiag("cannot read the function name list '%0': %1")
+        << Path << Buffer.getError().message();
+    return;
+  }
+
+  StringRef Text = (*Buffer)->getBuffer();
+  StringRef Line;
+  while (!Text.empty()) {
+    std::tie(Line, Text) = Text.split('\n');
+    Line = Line.trim();
+    if (!Line.empty() && !Line.starts_with("#")) {
+      Names.insert(Line);
+    }
+  }
+}
+
+void CallExpInIfChecker::checkPattern(StringRef Option, StringRef Pattern,
+                                      const llvm::Regex &Regex) {
+  std::string Error;
+  if (!Pattern.empty() && !Regex.isValid(Error)) {
+    configurationDiag("invalid regular expression '%0' for option '%1': %2")
+        << Pattern << Option << Error;
+  }
+}
+
+bool CallExpInIfChecker::isCalleeAccepted(const FunctionDecl *Function) {
+  auto [Iter, Inserted] =
+      CalleeVerdicts.try_emplace(Function->getCanonicalDecl(), false);
+  if (!Inserted) {
+    return Iter->second;
+  }
+
+  auto CalleeStringName = Function->getNameAsString();
+  Iter->second =
+      FilterRegex.match(CalleeStringName) &&
+      !IgnoreRegex.match(CalleeStringName) &&
+      (FilterFile.empty() || FilterNames.contains(CalleeStringName)) &&
+      !IgnoreNames.contains(CalleeStringName);
+  return Iter->second;
+}
+
+const std::optional<std::string> &
+CallExpInIfChecker::getReturnTypeSpelling(QualType Type) {
+  auto [Iter, Inserted] = ReturnTypeSpellings.try_emplace(Type);
+  if (!Inserted) {
+    return Iter->second;
+  }
+
+  // Checking type of the returned value
+  auto Spelling = Type.getAsString();
+  if (!IgnoreReturnTypeRegex.match(Spelling)) {
+    Iter->second = std::move(Spelling);
+  }
+  return Iter->second;
+}
 
 void CallExpInIfChecker::storeOptions(ClangTidyOptions::OptionMap &Opts) {
   Options.store(Opts, "Filter", Pattern);
@@ -25,180 +111,249 @@ void CallExpInIfChecker::storeOptions(ClangTidyOptions::OptionMap &Opts) {
   Options.store(Opts, "UseAllCallExpr", UseAllCallExpr);
   Options.store(Opts, "FromSystemCHeader", FromSystemCHeader);
   Options.store(Opts, "IgnoreFilter", IgnorePattern);
+  Options.store(Opts, "FilterFile", FilterFile);
+  Options.store(Opts, "IgnoreFilterFile", IgnoreFilterFile);
 }
 
-void CallExpInIfChecker::check(const MatchFinder::MatchResult &Result) {
-  const auto *IfStmtNode = Result.Nodes.getNodeAs<clang::IfStmt>("ifStmt");
-  const auto *CallExpr = Result.Nodes.getNodeAs<clang::CallExpr>("callExpr");
-  const auto *AssigmentExpression = Result.Nodes.getNodeAs<clang::Expr>("Expr");
-  const auto *IfStmtDeclRefExpr =
-      Result.Nodes.getNodeAs<clang::DeclRefExpr>("declRefExpr");
-
-  if (!IfStmtNode || !CallExpr) {
-    return;
-  }
-
-  auto *AstContext = Result.Context;
-  auto *Manager = Result.SourceManager;
-
-  if (!FromSystemCHeader) {
-    const auto *CallExprDecl = CallExpr->getDirectCallee();
-    if (!CallExprDecl) {
-      return;
-    }
-    auto CallExprLocation =
-        Manager->getSpellingLoc(CallExprDecl->getLocation());
-
-    if (Manager->isInSystemHeader(CallExprLocation)) {
+/// Appends the children of S that are evaluated whenever S is to the
+/// worklist, so that they are popped in the order of evaluation. The operands
+/// evaluated after a sequence point or conditionally are left out, hoisting
+/// them would change when or whether they are evaluated.
+static void pushEvaluatedChildren(const Stmt *S,
+                                  SmallVectorImpl<const Stmt *> &Worklist) {
+  if (const auto *BinaryOp = dyn_cast<BinaryOperator>(S)) {
+    if (BinaryOp->isLogicalOp() || BinaryOp->isCommaOp()) {
+      Worklist.push_back(BinaryOp->getLHS());
       return;
     }
   }
-
-  // Checking that CallExpr is in If Condition
-  const auto *IfStmtCondition = IfStmtNode->getCond();
-  const auto IfStmtConditionSourceRange =
-      IfStmtNode->getCond()->getSourceRange();
-  if (!IfStmtCondition || IfStmtConditionSourceRange.isInvalid()) {
+  if (const auto *Conditional = dyn_cast<ConditionalOperator>(S)) {
+    Worklist.push_back(Conditional->getCond());
     return;
   }
-  const auto IfStmtConditionExpansionSourceRange =
-      Manager->getExpansionRange(IfStmtConditionSourceRange);
-
-  if (IfStmtConditionExpansionSourceRange.isInvalid() ||
-      !IfStmtConditionExpansionSourceRange.getAsRange().fullyContains(
-          CallExpr->getSourceRange())) {
+  if (const auto *Conditional = dyn_cast<BinaryConditionalOperator>(S)) {
+    Worklist.push_back(Conditional->getCommon());
     return;
   }
-  // We don't want to check if with init storage
-  if (IfStmtNode->hasInitStorage()) {
+  // The operands are not evaluated or not evaluated in place.
+  if (isa<UnaryExprOrTypeTraitExpr, GenericSelectionExpr, CXXTypeidExpr,
+          CXXNoexceptExpr, LambdaExpr, BlockExpr, StmtExpr>(S)) {
     return;
   }
 
-  // We don't check "else if" condition
-  for (auto &&Parent : AstContext->getParents(*IfStmtNode)) {
-    if (const auto *ParentStmt = Parent.get<Stmt>()) {
-      if (const auto *ParentIfStmt = dyn_cast<IfStmt>(ParentStmt)) {
-        if (ParentIfStmt->hasElseStorage() &&
-            ParentIfStmt->getElse()->getID(*AstContext) ==
-                IfStmtNode->getID(*AstContext)) {
-          return;
-        }
-      }
+  auto FirstChild = Worklist.size();
+  for (const auto *Child : S->children()) {
+    if (Child) {
+      Worklist.push_back(Child);
     }
   }
+  std::reverse(Worklist.begin() + FirstChild, Worklist.end());
+}
 
-  // Checking based on the function name
-  if (const auto *Function = CallExpr->getCalleeDecl()->getAsFunction()) {
-    auto CalleeStringName = Function->getNameAsString();
-    static llvm::Regex CallExprRegex(Pattern);
-    if (!CallExprRegex.match(CalleeStringName)) {
-      return;
-    }
-    static llvm::Regex CallExprIgnoreRegex(IgnorePattern);
-    if (CallExprIgnoreRegex.match(CalleeStringName)) {
-      return;
-    }
+void CallExpInIfChecker::check(const MatchFinder::MatchResult &Result) {
+  const auto *FunctionDecl =
+      Result.Nodes.getNodeAs<clang::FunctionDecl>("functionDecl");
+  const auto &Candidates =
+      Analyses->getAnalysis(FunctionDecl, *Result.Context).getCandidates();
+  for (const auto *IfStmtNode : Candidates.IfStmts) {
+    runInternal(FunctionDecl, IfStmtNode,
+                Candidates.ElseIfStmts.count(IfStmtNode) != 0, Result);
   }
+}
 
-  std::string ReturnTypeString;
+void CallExpInIfChecker::onEndOfTranslationUnit() {
+  NextVariableIndex.clear();
+  CalleeVerdicts.clear();
+  ReturnTypeSpellings.clear();
+  Analyses->clear();
+}
 
-  if (UseAuto) {
-    ReturnTypeString = "auto";
-  } else {
+void CallExpInIfChecker::registerPPCallbacks(const SourceManager &SM,
+                                             Preprocessor *PP,
+                                             Preprocessor *ModuleExpanderPP) {
+  this->PP = PP;
+}
 
-    auto ReturnType = CallExpr->getCallReturnType(*AstContext);
+std::string CallExpInIfChecker::getVariableName(const FunctionDecl *Function,
+                                                SourceLocation Loc,
+                                                ASTContext &Context) {
+  const auto &Identifiers =
+      Analyses->getAnalysis(Function, Context).getIdentifiers();
+  auto IsMacro = [&](StringRef Name) {
+    if (!PP) {
+      return false;
+    }
+    auto *Identifier = PP->getIdentifierInfo(Name);
+    return Identifier->hadMacroDefinition() &&
+           PP->getMacroDefinitionAtLoc(Identifier, Loc);
+  };
+  auto &Index = NextVariableIndex[Function];
+  std::string Name;
+  do {
+    Name = (VariablePrefix + Twine(Index++)).str();
+  } while (Identifiers.contains(Name) || IsMacro(Name));
+  return Name;
+}
 
-    auto *Type = ReturnType.getTypePtrOrNull();
-    if (!Type || ReturnType.isNull()) {
-      return;
+std::optional<std::string>
+CallExpInIfChecker::getExtractedCallType(const clang::CallExpr *CallExpr,
+                                         ASTContext &Context) {
+  const auto &Manager = Context.getSourceManager();
+  if (!FromSystemCHeader) {
+    const auto *CallExprDecl = CallExpr->getDirectCallee();
+    if (!CallExprDecl) {
+      return std::nullopt;
     }
-    if (Type->isVoidType()) {
-      return;
+    auto CallExprLocation = Manager.getSpellingLoc(CallExprDecl->getLocation());
+
+    if (Manager.isInSystemHeader(CallExprLocation)) {
+      return std::nullopt;
     }
-    ReturnTypeString = ReturnType.getAsString();
-    // Checking type of the returned value
-    static llvm::Regex ReturnTypeRegex(IgnoreReturnTypePattern);
+  }
 
-    if (ReturnTypeRegex.match(ReturnTypeString)) {
-      return;
+  // Checking based on the function name
+  if (const auto *CalleeDecl = CallExpr->getCalleeDecl()) {
+    if (const auto *Function = CalleeDecl->getAsFunction()) {
+      if (!isCalleeAccepted(Function)) {
+        return std::nullopt;
+      }
     }
   }
 
-  // The offset of the new assignment will be like ifStmt
-  auto IfStmtIndent = clang::Lexer::getIndentationForLine(
-      Manager->getExpansionLoc(IfStmtNode->getBeginLoc()), *Manager);
+  auto ReturnType = CallExpr->getCallReturnType(Context);
+  auto *Type = ReturnType.getTypePtrOrNull();
+  if (!Type || ReturnType.isNull() || Type->isVoidType()) {
+    return std::nullopt;
+  }
+  if (UseAuto) {
+    return "auto";
+  }
+  return getReturnTypeSpelling(ReturnType);
+}
 
-  if (AssigmentExpression && UseDeclRefExpr) {
-    const auto *AssigmentExpressionWithoutParens =
-        AssigmentExpression->IgnoreParens();
-    if (!AssigmentExpressionWithoutParens) {
-      return;
+void CallExpInIfChecker::runInternal(const FunctionDecl *Function,
+                                     const IfStmt *IfStmtNode, bool IsElseIf,
+                                     const MatchFinder::MatchResult &Result) {
+  // The "else if" statements are handled along with the head of the chain.
+  if (IsElseIf) {
+    return;
+  }
+
+  IfChainFixBuilder Chain(IfStmtNode, *Analyses, *Result.Context);
+  SmallVector<FixItHint, 8> Fixes;
+  auto Links = Chain.getLinks();
+  for (unsigned Link = 0; Link < Links.size(); ++Link) {
+    if (!Chain.canInsertBefore(Link)) {
+      continue;
     }
-    auto AssigmentExpressionSourceCode = clang::Lexer::getSourceText(
-        clang::CharSourceRange::getTokenRange(
-            AssigmentExpressionWithoutParens->getSourceRange()),
-        *Manager, AstContext->getLangOpts());
+    SmallVector<std::string, 2> Statements;
+    extractCalls(Function, Links[Link], Result, Statements, Fixes);
+    Chain.insertBefore(Link, Statements);
+  }
+  if (Fixes.empty()) {
+    return;
+  }
 
-    auto Str = IfStmtIndent.str() + AssigmentExpressionSourceCode.str() + ";\n";
+  // The first fix replaces the first extracted call.
+  auto Diag =
+      diag(Fixes.front().RemoveRange.getBegin(),
+           "It looks like you are using function call in the if condition.");
+  Chain.takeFixes(Fixes);
+  for (auto &&Fix : Fixes) {
+    Diag << Fix;
+  }
+}
 
-    if (!IfStmtDeclRefExpr) {
-      return;
-    }
+void CallExpInIfChecker::extractCalls(
+    const FunctionDecl *Function, const IfStmt *IfStmtNode,
+    const MatchFinder::MatchResult &Result,
+    SmallVectorImpl<std::string> &Statements,
+    SmallVectorImpl<FixItHint> &Replacements) {
+  auto *AstContext = Result.Context;
+  auto *Manager = Result.SourceManager;
 
-    std::string VariableName;
-    if (const auto *IfStmtDeclRefExprDecl = IfStmtDeclRefExpr->getDecl()) {
-      VariableName = IfStmtDeclRefExprDecl->getNameAsString();
-    }
-    if (VariableName.empty()) {
-      return;
-    }
+  // We don't want to check if with init storage
+  if (IfStmtNode->hasInitStorage()) {
+    return;
+  }
 
-    auto Diag =
-        diag(AssigmentExpression->getBeginLoc(),
-             "It looks like you are using function call in the if condition.");
-    Diag << FixItHint::CreateReplacement(AssigmentExpression->getSourceRange(),
-                                         VariableName);
-    Diag << FixItHint::CreateInsertion(
-        IfStmtNode->getBeginLoc().getLocWithOffset(-IfStmtIndent.size()), Str);
+  const auto *IfStmtCondition = IfStmtNode->getCond();
+  if (!IfStmtCondition || IfStmtCondition->getSourceRange().isInvalid()) {
     return;
   }
-  if (!UseAllCallExpr) {
+  const auto IfStmtConditionExpansionSourceRange =
+      Manager->getExpansionRange(IfStmtCondition->getSourceRange());
+  if (IfStmtConditionExpansionSourceRange.isInvalid()) {
     return;
   }
-  auto CallExprSourceCode = clang::Lexer::getSourceText(
-      clang::CharSourceRange::getTokenRange(CallExpr->getSourceRange()),
-      *Manager, AstContext->getLangOpts());
 
-  auto VariableName = VariablePrefix + std::to_string(VariableCounter);
-  VariableCounter += 1;
+  // All calls of the condition are moved in front of the if at once, in the
+  // order of evaluation. An extracted expression is not walked into, the
+  // calls nested in it are moved along with it.
+  auto Extract = [&](const Expr *Replaced, StringRef Statement,
+                     StringRef VariableName) {
+    Statements.push_back(Statement.str());
+    Replacements.push_back(
+        FixItHint::CreateReplacement(Replaced->getSourceRange(), VariableName));
+  };
 
-  auto Str = IfStmtIndent.str() + ReturnTypeString + " " + VariableName +
-             " = " + CallExprSourceCode.str() + ";\n";
+  SmallVector<const Stmt *, 16> Worklist{IfStmtCondition};
+  while (!Worklist.empty()) {
+    const auto *S = Worklist.pop_back_val();
+    const auto *E = dyn_cast<Expr>(S);
+    if (!E || !IfStmtConditionExpansionSourceRange.getAsRange().fullyContains(
+                  E->getSourceRange())) {
+      pushEvaluatedChildren(S, Worklist);
+      continue;
+    }
 
-  auto Diag =
-      diag(CallExpr->getBeginLoc(),
-           "It looks like you are using function call in the if condition.");
-  Diag << FixItHint::CreateReplacement(CallExpr->getSourceRange(),
-                                       VariableName);
-  Diag << FixItHint::CreateInsertion(
-      IfStmtNode->getBeginLoc().getLocWithOffset(-IfStmtIndent.size()), Str);
+    // (x = call()) is moved as it is and x takes its place.
+    const auto *Assigment = dyn_cast<BinaryOperator>(E->IgnoreParens());
+    if (UseDeclRefExpr && Assigment && Assigment->isAssignmentOp()) {
+      const auto *Call = dyn_cast<CallExpr>(Assigment->getRHS());
+      const auto *DeclRef = dyn_cast<DeclRefExpr>(Assigment->getLHS());
+      if (Call && DeclRef && DeclRef->getDecl() &&
+          getExtractedCallType(Call, *AstContext)) {
+        auto AssigmentExpressionSourceCode = Analyses->getSourceText(
+            clang::CharSourceRange::getTokenRange(Assigment->getSourceRange()),
+            *AstContext);
+        auto VariableName = DeclRef->getDecl()->getNameAsString();
+        if (!VariableName.empty()) {
+          Extract(E, AssigmentExpressionSourceCode, VariableName);
+          continue;
+        }
+      }
+    }
+
+    const auto *Call = dyn_cast<CallExpr>(E);
+    if (UseAllCallExpr && Call) {
+      if (auto ReturnTypeString = getExtractedCallType(Call, *AstContext)) {
+        auto CallExprSourceCode = Analyses->getSourceText(
+            clang::CharSourceRange::getTokenRange(Call->getSourceRange()),
+            *AstContext);
+        auto VariableName = getVariableName(
+            Function, Manager->getExpansionLoc(IfStmtNode->getBeginLoc()),
+            *AstContext);
+        Extract(Call,
+                (Twine(*ReturnTypeString) + " " + VariableName + " = " +
+                 CallExprSourceCode)
+                    .str(),
+                VariableName);
+        continue;
+      }
+    }
+
+    pushEvaluatedChildren(S, Worklist);
+  }
 }
 
 void CallExpInIfChecker::registerMatchers(MatchFinder *Finder) {
-  auto IfStmtCallExprMatcher =
-      callExpr(
-          hasAncestor(ifStmt().bind("ifStmt")),
-          unless(hasAncestor(binaryOperator(unless(isComparisonOperator()),
-                                            unless(isAssignmentOperator())))))
-          .bind("callExpr");
-
-  auto IfStmtCallExprDeclRefMatcher =
-      expr(has(binaryOperator(isAssignmentOperator(),
-                              hasRHS(IfStmtCallExprMatcher),
-                              hasLHS(declRefExpr().bind("declRefExpr")))
-                   .bind("binaryOperator")))
-          .bind("Expr");
-
-  Finder->addMatcher(IfStmtCallExprDeclRefMatcher, this);
-  Finder->addMatcher(IfStmtCallExprMatcher, this);
+  // The if statements are taken from the traversal of the function body
+  // shared by all checks of the module. The enclosing function scopes the
+  // names of the new variables, and no ancestor of an if is ever looked up.
+  Finder->addMatcher(
+      functionDecl(isDefinition(),
+                   unless(anyOf(isDefaulted(), isDeleted(), isWeak())))
+          .bind("functionDecl"),
+      this);
 }
@@ -2,21 +2,74 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_CALLEXPRINIFCHECKER_H
 
 #include "../ClangTidyCheck.h"
+#include "FunctionAnalysisManager.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Regex.h"
+#include <optional>
 
 namespace clang::tidy::autorefactorings {
 
 class CallExpInIfChecker : public ClangTidyCheck {
 public:
   CallExpInIfChecker(StringRef Name, ClangTidyContext *Context);
+  CallExpInIfChecker(StringRef Name, ClangTidyContext *Context,
+                     std::shared_ptr<FunctionAnalysisManager> Analyses);
   void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
   bool isLanguageVersionSupported(const LangOptions &LangOpts) const override {
     return true;
   }
   void registerMatchers(ast_matchers::MatchFinder *Finder) override;
   void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
+  void onEndOfTranslationUnit() override;
+  void registerPPCallbacks(const SourceManager &SM, Preprocessor *PP,
+                           Preprocessor *ModuleExpanderPP) override;
+  void runInternal(const FunctionDecl *Function, const IfStmt *IfStmtNode,
+                   bool IsElseIf,
+                   const ast_matchers::MatchFinder::MatchResult &Result);
 
 private:
-  int VariableCounter = 0;
+  /// Appends the statements that the extracted calls of the condition are
+  /// moved to and the replacements of the calls.
+  void extractCalls(const FunctionDecl *Function, const IfStmt *IfStmtNode,
+                    const ast_matchers::MatchFinder::MatchResult &Result,
+                    SmallVectorImpl<std::string> &Statements,
+                    SmallVectorImpl<FixItHint> &Replacements);
+
+  /// The type of the variable the result of the call is stored in, or
+  /// std::nullopt if the call is not extracted.
+  std::optional<std::string> getExtractedCallType(const CallExpr *CallExpr,
+                                                  ASTContext &Context);
+
+  /// The next name of the form <VariablePrefix><N> that is not used in the
+  /// function and is not a macro at the location of the new variable. The
+  /// numbering starts anew in every function.
+  std::string getVariableName(const FunctionDecl *Function,
+                              SourceLocation Loc, ASTContext &Context);
+
+  /// Whether the calls of the function pass the name filters, memoized per
+  /// function.
+  bool isCalleeAccepted(const FunctionDecl *Function);
+
+  /// The spelling of the type of the new variable, or std::nullopt if the
+  /// type is ignored. Memoized per type.
+  const std::optional<std::string> &getReturnTypeSpelling(QualType Type);
+
+  /// Reads a file with a function name on every line, empty lines and lines
+  /// starting with '#' are skipped.
+  void loadNameList(StringRef Path, llvm::StringSet<> &Names);
+
+  /// Reports the pattern of the option if it is not a valid regular
+  /// expression. An empty pattern is not checked, it means no filter.
+  void checkPattern(StringRef Option, StringRef Pattern,
+                    const llvm::Regex &Regex);
+
+  std::shared_ptr<FunctionAnalysisManager> Analyses;
+  // The macros of the TU, null until the callbacks are registered.
+  Preprocessor *PP = nullptr;
+
+  // The next index of the variable names of every function of the TU.
+  llvm::DenseMap<const FunctionDecl *, unsigned> NextVariableIndex;
   bool UseAuto;
   bool UseDeclRefExpr;
   bool UseAllCallExpr;
@@ -25,6 +78,21 @@ private:
   std::string Pattern;
   std::string IgnorePattern;
   std::string IgnoreReturnTypePattern;
+  std::string FilterFile;
+  std::string IgnoreFilterFile;
+
+  // The filters are compiled once for every instance of the check.
+  llvm::Regex FilterRegex;
+  llvm::Regex IgnoreRegex;
+  llvm::Regex IgnoreReturnTypeRegex;
+  // Empty if no file is given.
+  llvm::StringSet<> FilterNames;
+  llvm::StringSet<> IgnoreNames;
+
+  // The verdicts of the filters for the TU. The functions are keyed by their
+  // canonical decl.
+  llvm::DenseMap<const FunctionDecl *, bool> CalleeVerdicts;
+  llvm::DenseMap<QualType, std::optional<std::string>> ReturnTypeSpellings;
 };
 }; // namespace clang::tidy::autorefactorings
 
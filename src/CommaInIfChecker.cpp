@@ -1,152 +1,222 @@
 #include "CommaInIfChecker.h"
+#include "IfChainFixBuilder.h"
 #include "clang/Lex/Preprocessor.h"
 
+using namespace clang;
 using namespace clang::ast_matchers;
 using namespace clang::tidy::autorefactorings;
 
 CommaInIfChecker::CommaInIfChecker(StringRef Name, ClangTidyContext *Context)
-    : ClangTidyCheck(Name, Context) {}
+    : CommaInIfChecker(Name, Context,
+                       std::make_shared<FunctionAnalysisManager>(
+                           Context->getOptions().CheckOptions)) {}
+
+CommaInIfChecker::CommaInIfChecker(
+    StringRef Name, ClangTidyContext *Context,
+    std::shared_ptr<FunctionAnalysisManager> Analyses)
+    : ClangTidyCheck(Name, Context), Analyses(std::move(Analyses)),
+      FusedTraversal(Options.getLocalOrGlobal("FusedTraversal", false)) {}
+
+void CommaInIfChecker::storeOptions(ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "FusedTraversal", FusedTraversal);
+}
+
+/// Returns the comma operator the if condition consists of, looking through
+/// parentheses, casts and unary operators, or null if there is none.
+static const BinaryOperator *getConditionComma(const Expr *Condition) {
+  while (Condition) {
+    if (const auto *BinaryOp = dyn_cast<BinaryOperator>(Condition)) {
+      return BinaryOp->isCommaOp() ? BinaryOp : nullptr;
+    }
+    if (const auto *Paren = dyn_cast<ParenExpr>(Condition)) {
+      Condition = Paren->getSubExpr();
+    } else if (const auto *Cast = dyn_cast<CastExpr>(Condition)) {
+      Condition = Cast->getSubExpr();
+    } else if (const auto *UnaryOp = dyn_cast<UnaryOperator>(Condition)) {
+      Condition = UnaryOp->getSubExpr();
+    } else {
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+/// Appends the operands of the comma operator tree to Operands in the order
+/// of evaluation. Parenthesized comma operands are flattened as well.
+static void flattenComma(const BinaryOperator *Comma,
+                         SmallVectorImpl<const Expr *> &Operands) {
+  SmallVector<const Expr *, 16> Worklist{Comma};
+  while (!Worklist.empty()) {
+    const auto *Operand = Worklist.pop_back_val();
+    const auto *BinaryOp = dyn_cast<BinaryOperator>(Operand->IgnoreParens());
+    if (BinaryOp && BinaryOp->isCommaOp()) {
+      Worklist.push_back(BinaryOp->getRHS());
+      Worklist.push_back(BinaryOp->getLHS());
+      continue;
+    }
+    Operands.push_back(Operand);
+  }
+}
 
 void CommaInIfChecker::check(const MatchFinder::MatchResult &Result) {
-  const auto *ConditionExpr =
-      Result.Nodes.getNodeAs<clang::Expr>("conditionExpr");
+  if (const auto *FunctionDecl =
+          Result.Nodes.getNodeAs<clang::FunctionDecl>("functionDecl")) {
+    const auto &Candidates =
+        Analyses->getAnalysis(FunctionDecl, *Result.Context).getCandidates();
+    for (const auto *IfStmtNode : Candidates.IfStmts) {
+      runInternal(IfStmtNode, Candidates.ElseIfStmts.count(IfStmtNode) != 0,
+                  Result);
+    }
+    return;
+  }
+
   const auto *IfStmtNode = Result.Nodes.getNodeAs<clang::IfStmt>("ifStmt");
-  const auto *FirstBinaryOperator =
-      Result.Nodes.getNodeAs<clang::BinaryOperator>("binaryOperator");
-  auto *const Manager = Result.SourceManager;
+  if (!IfStmtNode) {
+    return;
+  }
 
-  if (FirstBinaryOperator && !ConditionExpr) {
-    ConditionExpr = IfStmtNode->getCond();
+  // If statements are matched in pre-order, so an "else if" is always
+  // recorded by its parent before it is matched itself.
+  if (const auto *ElseIfStmt =
+          dyn_cast_or_null<IfStmt>(IfStmtNode->getElse())) {
+    ElseIfStmts.insert(ElseIfStmt);
   }
+  runInternal(IfStmtNode, ElseIfStmts.count(IfStmtNode) != 0, Result);
+}
 
-  // Checking that ConditionExpr is in If Condition
-  if (!Manager->getExpansionRange(IfStmtNode->getCond()->getSourceRange())
-           .getAsRange()
-           .fullyContains(ConditionExpr->getSourceRange())) {
+void CommaInIfChecker::onEndOfTranslationUnit() {
+  ElseIfStmts.clear();
+  Analyses->clear();
+}
+
+void CommaInIfChecker::runInternal(const IfStmt *IfStmtNode, bool IsElseIf,
+                                   const MatchFinder::MatchResult &Result) {
+  // The "else if" statements are handled along with the head of the chain.
+  if (IsElseIf) {
     return;
   }
 
-  auto InitOffset = FirstBinaryOperator ? -1 : 0;
-  auto ConditionExprBeginLocation = Manager->getExpansionLoc(
-      ConditionExpr->getBeginLoc().getLocWithOffset(InitOffset));
-  const auto ConditionExprEndLocation =
-      Manager->getExpansionLoc(ConditionExpr->getEndLoc());
-
-  auto *const AstContext = Result.Context;
-
-  for (auto &&Parent : AstContext->getParents(*IfStmtNode)) {
-    if (const auto *ParentStmt = Parent.get<Stmt>()) {
-      if (const auto *ParentIfStmt = dyn_cast<IfStmt>(ParentStmt)) {
-        if (ParentIfStmt->hasElseStorage() &&
-            ParentIfStmt->getElse()->getID(*AstContext) ==
-                IfStmtNode->getID(*AstContext)) {
-          return;
-        }
-      }
+  IfChainFixBuilder Chain(IfStmtNode, *Analyses, *Result.Context);
+  SmallVector<FixItHint, 8> Fixes;
+  SourceLocation DiagLoc;
+  auto Links = Chain.getLinks();
+  for (unsigned Link = 0; Link < Links.size(); ++Link) {
+    if (!Chain.canInsertBefore(Link)) {
+      continue;
+    }
+    SmallVector<std::string, 2> Statements;
+    if (!splitComma(Links[Link], Result, Statements, Fixes)) {
+      continue;
+    }
+    Chain.insertBefore(Link, Statements);
+    if (DiagLoc.isInvalid()) {
+      DiagLoc = Links[Link]->getCond()->getBeginLoc();
     }
   }
+  if (Fixes.empty()) {
+    return;
+  }
 
-  clang::SourceLocation CurrentExpressionBeginLocation =
-      ConditionExprBeginLocation;
-  clang::SourceLocation LastCommaLocation;
-
-  std::list<std::string> Expressions;
-
-  // The offset of the new assignment will be like ifStmt
-  auto IfStmtIndent = clang::Lexer::getIndentationForLine(
-      Manager->getExpansionLoc(IfStmtNode->getBeginLoc()), *Manager);
+  auto Diag = diag(DiagLoc,
+                   "It looks like you are using comma in the if condition.");
+  Chain.takeFixes(Fixes);
+  for (auto &&Fix : Fixes) {
+    Diag << Fix;
+  }
+}
 
-  int ParenCounter = 0;
-  while (CurrentExpressionBeginLocation.isValid() &&
-         CurrentExpressionBeginLocation < ConditionExprEndLocation) {
+bool CommaInIfChecker::splitComma(const IfStmt *IfStmtNode,
+                                  const MatchFinder::MatchResult &Result,
+                                  SmallVectorImpl<std::string> &Statements,
+                                  SmallVectorImpl<FixItHint> &Replacements) {
+  // We don't check if with init storage
+  if (IfStmtNode->hasInitStorage()) {
+    return false;
+  }
 
-    auto NextTokenOptional = clang::Lexer::findNextToken(
-        Manager->getExpansionLoc(CurrentExpressionBeginLocation), *Manager,
-        AstContext->getLangOpts());
+  const auto *Comma = getConditionComma(IfStmtNode->getCond());
+  if (!Comma) {
+    return false;
+  }
 
-    if (NextTokenOptional.has_value()) {
-      auto NextToken = NextTokenOptional.value();
+  const auto &Context = *Result.Context;
+
+  auto GetFileRange = [&](const Expr *E) {
+    return Analyses->makeFileCharRange(
+        clang::CharSourceRange::getTokenRange(E->getSourceRange()), Context);
+  };
+  auto GetSourceCode = [&](clang::SourceLocation Begin,
+                           clang::SourceLocation End) {
+    return Analyses->getSourceText(
+        clang::CharSourceRange::getCharRange(Begin, End), Context);
+  };
+
+  auto CommaRange = GetFileRange(Comma);
+  if (CommaRange.isInvalid()) {
+    return false;
+  }
 
-      if (NextToken.is(clang::tok::l_paren)) {
-        ParenCounter += 1;
-      }
-      if (NextToken.is(clang::tok::r_paren)) {
-        ParenCounter -= 1;
+  // Every operand except the last one becomes a statement. When the last
+  // operand contains a comma operator itself, e.g. "!(b, c)", that one is
+  // flattened too and the text around it is kept in the new condition.
+  SmallVector<std::string, 2> OperandStatements;
+  std::string Condition;
+  // The text after every inner comma, the outermost first.
+  SmallVector<StringRef, 4> Suffixes;
+  SmallVector<const Expr *, 16> Operands;
+  while (true) {
+    Operands.clear();
+    flattenComma(Comma, Operands);
+    for (const auto *Operand : llvm::ArrayRef(Operands).drop_back()) {
+      auto OperandRange = GetFileRange(Operand);
+      if (OperandRange.isInvalid()) {
+        return false;
       }
+      OperandStatements.push_back(
+          GetSourceCode(OperandRange.getBegin(), OperandRange.getEnd())
+              .str());
+    }
 
-      CurrentExpressionBeginLocation =
-          Manager->getExpansionLoc(NextToken.getLocation());
-      if (NextToken.getKind() != clang::tok::comma || ParenCounter != 0) {
-        continue;
-      }
+    auto LastOperandRange = GetFileRange(Operands.back());
+    if (LastOperandRange.isInvalid()) {
+      return false;
     }
-    if (CurrentExpressionBeginLocation.isValid() &&
-        CurrentExpressionBeginLocation < ConditionExprEndLocation) {
-      auto CurrentSourceRange =
-          clang::SourceRange({ConditionExprBeginLocation.getLocWithOffset(1),
-                              CurrentExpressionBeginLocation});
-
-      auto CurrentExprSourceCode = clang::Lexer::getSourceText(
-          clang::CharSourceRange::getCharRange(CurrentSourceRange), *Manager,
-          AstContext->getLangOpts());
-
-      ConditionExprBeginLocation = CurrentExpressionBeginLocation;
-      CurrentExprSourceCode = CurrentExprSourceCode.ltrim();
-      Expressions.push_back(IfStmtIndent.str() + CurrentExprSourceCode.str() +
-                            ";\n");
-      ConditionExprBeginLocation = CurrentExpressionBeginLocation;
-      LastCommaLocation = CurrentExpressionBeginLocation;
-      continue;
+    const auto *InnerComma = getConditionComma(Operands.back());
+    if (!InnerComma) {
+      Condition += GetSourceCode(LastOperandRange.getBegin(),
+                                 LastOperandRange.getEnd());
+      break;
     }
-    break;
-  }
-
-  if (LastCommaLocation.isInvalid() ||
-      LastCommaLocation >= ConditionExprEndLocation) {
-    return;
+    auto InnerCommaRange = GetFileRange(InnerComma);
+    if (InnerCommaRange.isInvalid()) {
+      return false;
+    }
+    Condition += GetSourceCode(LastOperandRange.getBegin(),
+                               InnerCommaRange.getBegin());
+    Suffixes.push_back(
+        GetSourceCode(InnerCommaRange.getEnd(), LastOperandRange.getEnd()));
+    Comma = InnerComma;
   }
 
-  int Offset = FirstBinaryOperator ? 0 : 1;
-  auto LastSourceRange =
-      clang::SourceRange({LastCommaLocation.getLocWithOffset(1),
-                          ConditionExprEndLocation.getLocWithOffset(-Offset)});
-  auto LastExpressionsSourceCode =
-      clang::Lexer::getSourceText(
-          clang::CharSourceRange::getTokenRange(LastSourceRange), *Manager,
-          AstContext->getLangOpts())
-          .ltrim()
-          .str();
-
-  auto Diag = diag(ConditionExpr->getBeginLoc(),
-                   "It looks like you are using comma in the if condition.");
-
-  for (auto &&Expression : Expressions) {
-    Diag << FixItHint::CreateInsertion(
-        IfStmtNode->getBeginLoc().getLocWithOffset(-IfStmtIndent.size()),
-        Expression);
+  for (auto Suffix : llvm::reverse(Suffixes)) {
+    Condition += Suffix;
   }
-  auto ConditionExprSourceRange = ConditionExpr->getSourceRange();
-  auto ExprBeginLocation = ConditionExprSourceRange.getBegin();
-  auto ExprEndLocation = ConditionExprSourceRange.getEnd();
-  auto NewSourceRange =
-      clang::SourceRange({ExprBeginLocation.getLocWithOffset(Offset),
-                          ExprEndLocation.getLocWithOffset(-Offset)});
-  Diag << FixItHint::CreateReplacement(NewSourceRange,
-                                       LastExpressionsSourceCode);
+  Statements.append(OperandStatements.begin(), OperandStatements.end());
+  Replacements.push_back(FixItHint::CreateReplacement(CommaRange, Condition));
+  return true;
 }
 
 void CommaInIfChecker::registerMatchers(MatchFinder *Finder) {
-  Finder->addMatcher(parenExpr(has(binaryOperator(hasOperatorName(","))),
-                               hasAncestor(ifStmt().bind("ifStmt")),
-                               unless(hasAncestor(binaryOperator())),
-                               unless(hasAncestor(callExpr())))
-                         .bind("conditionExpr"),
-                     this);
-
-  Finder->addMatcher(binaryOperator(hasOperatorName(","),
-                                    hasParent(ifStmt().bind("ifStmt")),
-                                    unless(hasAncestor(binaryOperator())),
-                                    unless(hasAncestor(parenExpr())))
-                         .bind("binaryOperator"),
-                     this);
+  if (FusedTraversal) {
+    Finder->addMatcher(
+        functionDecl(isDefinition(),
+                     unless(anyOf(isDefaulted(), isDeleted(), isWeak())))
+            .bind("functionDecl"),
+        this);
+    return;
+  }
+
+  // The comma operator is found by walking the condition down from the if
+  // statement, which avoids the ancestor walks of matching every comma.
+  Finder->addMatcher(ifStmt().bind("ifStmt"), this);
 }
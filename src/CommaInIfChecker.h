@@ -2,18 +2,44 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_COMMAINIFCHECKER_H
 
 #include "../ClangTidyCheck.h"
+#include "FunctionAnalysisManager.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include <string>
 
 namespace clang::tidy::autorefactorings {
 
 class CommaInIfChecker : public ClangTidyCheck {
 public:
   CommaInIfChecker(StringRef Name, ClangTidyContext *Context);
+  CommaInIfChecker(StringRef Name, ClangTidyContext *Context,
+                   std::shared_ptr<FunctionAnalysisManager> Analyses);
   bool isLanguageVersionSupported(const LangOptions &LangOpts) const override {
     return true;
   }
-  //   void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
+  void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
   void registerMatchers(ast_matchers::MatchFinder *Finder) override;
   void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
+  void onEndOfTranslationUnit() override;
+  void runInternal(const IfStmt *IfStmtNode, bool IsElseIf,
+                   const ast_matchers::MatchFinder::MatchResult &Result);
+
+private:
+  /// Splits the comma operator of the if condition, appending the operands
+  /// evaluated before the condition to Statements and the replacement of the
+  /// comma operator to Replacements. Returns false if nothing changes.
+  bool splitComma(const IfStmt *IfStmtNode,
+                  const ast_matchers::MatchFinder::MatchResult &Result,
+                  SmallVectorImpl<std::string> &Statements,
+                  SmallVectorImpl<FixItHint> &Replacements);
+
+  std::shared_ptr<FunctionAnalysisManager> Analyses;
+
+  // "else if" statements of the already matched if statements of the TU.
+  llvm::SmallPtrSet<const IfStmt *, 8> ElseIfStmts;
+
+  // Take the candidates from the traversal of the function body shared by
+  // all checks of the module instead of running own matchers.
+  bool FusedTraversal;
 };
 }; // namespace clang::tidy::autorefactorings
 
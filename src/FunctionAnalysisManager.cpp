@@ -0,0 +1,599 @@
+#include "FunctionAnalysisManager.h"
+#include "AutoRefactoringModuleUtils.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/ParentMap.h"
+#include "clang/AST/TypeLoc.h"
+#include "clang/Analysis/CFG.h"
+#include "clang/Analysis/CFGStmtMap.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/PointerIntPair.h"
+#include "llvm/ADT/SetVector.h"
+#include <algorithm>
+
+using namespace clang;
+using namespace clang::tidy::autorefactorings;
+
+/// The number of blocks which the CFG builder always creates for the
+/// statement in addition to the block that contains it.
+static unsigned getEstimatedNewBlocks(const Stmt *S) {
+  switch (S->getStmtClass()) {
+  case Stmt::ForStmtClass:
+  case Stmt::WhileStmtClass:
+  case Stmt::DoStmtClass:
+  case Stmt::ConditionalOperatorClass:
+  case Stmt::BinaryConditionalOperatorClass:
+    return 3;
+  case Stmt::SwitchStmtClass:
+  case Stmt::CaseStmtClass:
+  case Stmt::DefaultStmtClass:
+  case Stmt::LabelStmtClass:
+    return 1;
+  case Stmt::BinaryOperatorClass:
+    return cast<BinaryOperator>(S)->isLogicalOp() ? 1 : 0;
+  default:
+    return 0;
+  }
+}
+
+/// Calls Func with the roots of the statement trees of the function: the
+/// constructor initializers and the body.
+template <typename Functor>
+static void forEachRootStmt(const FunctionDecl *Function, Functor &&Func) {
+  if (const auto *Constructor = dyn_cast<CXXConstructorDecl>(Function)) {
+    for (const auto *Initializer : Constructor->inits()) {
+      if (auto *Init = Initializer->getInit()) {
+        Func(Init);
+      }
+    }
+  }
+  if (auto *Body = Function->getBody()) {
+    Func(Body);
+  }
+}
+
+/// Collects the candidates with an explicit work stack, so that deeply nested
+/// if statements need no native stack. The conditions are walked as well, as
+/// GNU statement expressions may hide if and goto statements in them.
+static void collectCandidates(const FunctionDecl *Function,
+                              FunctionCandidates &Candidates) {
+  // The flag marks the exit from an if statement, which is popped after all
+  // the statements nested in it.
+  SmallVector<llvm::PointerIntPair<Stmt *, 1, bool>, 32> Worklist;
+  auto Walk = [&](Stmt *Root) {
+    Worklist.push_back({Root, false});
+    while (!Worklist.empty()) {
+      auto Item = Worklist.pop_back_val();
+      auto *CurrentStmt = Item.getPointer();
+      auto *CurrentIf = dyn_cast<IfStmt>(CurrentStmt);
+      if (Item.getInt()) {
+        Candidates.IfStmtsInnerFirst.push_back(CurrentIf);
+        continue;
+      }
+
+      // The children are pushed in reverse, so they are popped in source
+      // order.
+      if (CurrentIf) {
+        Candidates.IfStmts.push_back(CurrentIf);
+        Candidates.EstimatedCFGBlocks += CurrentIf->getElse() ? 3 : 2;
+        Worklist.push_back({CurrentIf, true});
+        if (auto *ElseStmt = CurrentIf->getElse()) {
+          if (const auto *ElseIfStmt = dyn_cast<IfStmt>(ElseStmt)) {
+            Candidates.ElseIfStmts.insert(ElseIfStmt);
+          }
+          Worklist.push_back({ElseStmt, false});
+        }
+        if (auto *ThenStmt = CurrentIf->getThen()) {
+          Worklist.push_back({ThenStmt, false});
+        }
+        if (auto *Cond = CurrentIf->getCond()) {
+          Worklist.push_back({Cond, false});
+        }
+        if (auto *CondVar = CurrentIf->getConditionVariableDeclStmt()) {
+          Worklist.push_back({CondVar, false});
+        }
+        if (auto *Init = CurrentIf->getInit()) {
+          Worklist.push_back({Init, false});
+        }
+        continue;
+      }
+
+      Candidates.EstimatedCFGBlocks += getEstimatedNewBlocks(CurrentStmt);
+      if (auto *CurrentGotoStmt = dyn_cast<GotoStmt>(CurrentStmt)) {
+        Candidates.GotoStmts.push_back(CurrentGotoStmt);
+      }
+      auto FirstChild = Worklist.size();
+      for (auto *Child : CurrentStmt->children()) {
+        if (Child) {
+          Worklist.push_back({Child, false});
+        }
+      }
+      std::reverse(Worklist.begin() + FirstChild, Worklist.end());
+    }
+  };
+  forEachRootStmt(Function, Walk);
+}
+
+static void addIdentifier(const NamedDecl *Decl,
+                          llvm::StringSet<> &Identifiers) {
+  if (Decl && Decl->getIdentifier()) {
+    Identifiers.insert(Decl->getName());
+  }
+}
+
+/// Adds the names of the typedef, tag and enum types spelled in the type,
+/// including the types of the parameters of a spelled function type.
+static void addTypeNames(const TypeSourceInfo *TypeInfo,
+                         llvm::StringSet<> &Identifiers) {
+  if (!TypeInfo) {
+    return;
+  }
+  SmallVector<TypeLoc, 8> Worklist{TypeInfo->getTypeLoc()};
+  while (!Worklist.empty()) {
+    for (auto Loc = Worklist.pop_back_val(); Loc; Loc = Loc.getNextTypeLoc()) {
+      if (auto Typedef = Loc.getAs<TypedefTypeLoc>()) {
+        addIdentifier(Typedef.getTypedefNameDecl(), Identifiers);
+      } else if (auto Tag = Loc.getAs<TagTypeLoc>()) {
+        addIdentifier(Tag.getDecl(), Identifiers);
+      } else if (auto Function = Loc.getAs<FunctionProtoTypeLoc>()) {
+        for (const auto *Param : Function.getParams()) {
+          if (Param && Param->getTypeSourceInfo()) {
+            Worklist.push_back(Param->getTypeSourceInfo()->getTypeLoc());
+          }
+        }
+      }
+    }
+  }
+}
+
+/// The type spelled in the statement, if any.
+static const TypeSourceInfo *getWrittenType(const Stmt *S) {
+  if (const auto *Cast = dyn_cast<ExplicitCastExpr>(S)) {
+    return Cast->getTypeInfoAsWritten();
+  }
+  if (const auto *TypeTrait = dyn_cast<UnaryExprOrTypeTraitExpr>(S)) {
+    return TypeTrait->isArgumentType() ? TypeTrait->getArgumentTypeInfo()
+                                       : nullptr;
+  }
+  if (const auto *Literal = dyn_cast<CompoundLiteralExpr>(S)) {
+    return Literal->getTypeSourceInfo();
+  }
+  if (const auto *OffsetOf = dyn_cast<OffsetOfExpr>(S)) {
+    return OffsetOf->getTypeSourceInfo();
+  }
+  if (const auto *VAArg = dyn_cast<VAArgExpr>(S)) {
+    return VAArg->getWrittenTypeInfo();
+  }
+  return nullptr;
+}
+
+/// Collects the names of the parameters, of the declarations declared or
+/// referenced in the statements of the function and of the types spelled in
+/// them, with an explicit work stack. A new variable with one of these names
+/// could hide a declaration used after it.
+static void collectIdentifiers(const FunctionDecl *Function,
+                               llvm::StringSet<> &Identifiers) {
+  for (const auto *Param : Function->parameters()) {
+    addIdentifier(Param, Identifiers);
+    addTypeNames(Param->getTypeSourceInfo(), Identifiers);
+  }
+
+  SmallVector<const Stmt *, 32> Worklist;
+  forEachRootStmt(Function,
+                  [&](const Stmt *Root) { Worklist.push_back(Root); });
+  while (!Worklist.empty()) {
+    const auto *CurrentStmt = Worklist.pop_back_val();
+    addTypeNames(getWrittenType(CurrentStmt), Identifiers);
+    if (const auto *Declaration = dyn_cast<DeclStmt>(CurrentStmt)) {
+      for (const auto *Decl : Declaration->decls()) {
+        addIdentifier(dyn_cast<NamedDecl>(Decl), Identifiers);
+        if (const auto *Declarator = dyn_cast<DeclaratorDecl>(Decl)) {
+          addTypeNames(Declarator->getTypeSourceInfo(), Identifiers);
+        } else if (const auto *Typedef = dyn_cast<TypedefNameDecl>(Decl)) {
+          addTypeNames(Typedef->getTypeSourceInfo(), Identifiers);
+        }
+      }
+    } else if (const auto *Ref = dyn_cast<DeclRefExpr>(CurrentStmt)) {
+      addIdentifier(Ref->getDecl(), Identifiers);
+    } else if (const auto *Member = dyn_cast<MemberExpr>(CurrentStmt)) {
+      addIdentifier(Member->getMemberDecl(), Identifiers);
+    }
+    for (const auto *Child : CurrentStmt->children()) {
+      if (Child) {
+        Worklist.push_back(Child);
+      }
+    }
+  }
+}
+
+FunctionAnalysis::FunctionAnalysis(const FunctionDecl *Function,
+                                   ASTContext &Context)
+    : Function(Function), Context(Context) {}
+
+FunctionAnalysis::~FunctionAnalysis() = default;
+
+const FunctionCandidates &FunctionAnalysis::getCandidates() {
+  if (!Candidates) {
+    Candidates = std::make_unique<FunctionCandidates>();
+    collectCandidates(Function, *Candidates);
+  }
+  return *Candidates;
+}
+
+const llvm::StringSet<> &FunctionAnalysis::getIdentifiers() {
+  if (!Identifiers) {
+    Identifiers = std::make_unique<llvm::StringSet<>>();
+    collectIdentifiers(Function, *Identifiers);
+  }
+  return *Identifiers;
+}
+
+clang::CFG *FunctionAnalysis::getCFG() {
+  if (!IsCFGBuilt) {
+    IsCFGBuilt = true;
+    // The checks look only at the statements of the blocks and the edges
+    // between them, none of the optional CFG elements is needed.
+    Cfg = CFG::buildCFG(Function, Function->getBody(), &Context,
+                        CFG::BuildOptions());
+  }
+  return Cfg.get();
+}
+
+bool FunctionAnalysis::exceedsCFGLimit(unsigned MaxBlocks) {
+  if (getCandidates().EstimatedCFGBlocks > MaxBlocks) {
+    return true;
+  }
+  const auto *FunctionCfg = getCFG();
+  return FunctionCfg && FunctionCfg->size() > MaxBlocks;
+}
+
+ParentMap &FunctionAnalysis::getParentMap() {
+  if (!PMap) {
+    PMap = std::make_unique<ParentMap>(Function->getBody());
+  }
+  return *PMap;
+}
+
+const clang::CFGStmtMap &FunctionAnalysis::getStmtMap() {
+  if (!StmtToBlockMap) {
+    assert(getCFG() && "The statement map requires a CFG");
+    StmtToBlockMap.reset(CFGStmtMap::Build(getCFG(), &getParentMap()));
+  }
+  return *StmtToBlockMap;
+}
+
+CFGBlockReachability &
+FunctionAnalysis::getReachability(unsigned MaxDenseBlocks) {
+  if (!Reachability) {
+    assert(getCFG() && "The reachability analysis requires a CFG");
+    Reachability =
+        std::make_unique<CFGBlockReachability>(*getCFG(), MaxDenseBlocks);
+  }
+  return *Reachability;
+}
+
+/// Computes the same results as the Utils predicates, but resolves the
+/// expansion locations of the elements only once.
+static CFGBlockSummary summarizeBlock(const CFGBlock *Block, const CFG &Cfg,
+                                      const SourceManager &Manager) {
+  CFGBlockSummary Summary;
+  for (auto &&BlockElement : Block->Elements) {
+    auto CfgStmtElement = BlockElement.getAs<CFGStmt>();
+    if (!CfgStmtElement) {
+      Summary.HasNonStmtElements = true;
+      break;
+    }
+    const auto *ElementStmt = CfgStmtElement->getStmt();
+    auto Begin = Manager.getExpansionLoc(ElementStmt->getBeginLoc());
+    auto End = Manager.getExpansionLoc(ElementStmt->getEndLoc());
+    if (Summary.Begin.isInvalid() || Begin < Summary.Begin) {
+      Summary.Begin = Begin;
+    }
+    if (Summary.End.isInvalid() || Summary.End < End) {
+      Summary.End = End;
+    }
+  }
+
+  if (!Block->empty()) {
+    Summary.InterruptStmt = Utils::getInterruptStatement(Block);
+    if (auto LastElement = Block->back().getAs<CFGStmt>()) {
+      const auto *Return = dyn_cast<ReturnStmt>(LastElement->getStmt());
+      Summary.IsOnlyReturn = Return && Summary.isInStmt(Return);
+    }
+  }
+  Summary.IsInterruption = Block->getBlockID() == Cfg.getExit().getBlockID() ||
+                           Summary.IsOnlyReturn || Block->hasNoReturnElement();
+  return Summary;
+}
+
+const CFGBlockSummary &
+FunctionAnalysis::getBlockSummary(const CFGBlock *Block) {
+  if (BlockSummaries.empty()) {
+    assert(getCFG() && "The block summaries require a CFG");
+    const auto &Cfg = *getCFG();
+    BlockSummaries.resize(Cfg.getNumBlockIDs());
+    for (const auto *CfgBlock : Cfg) {
+      BlockSummaries[CfgBlock->getBlockID()] =
+          summarizeBlock(CfgBlock, Cfg, Context.getSourceManager());
+    }
+  }
+  return BlockSummaries[Block->getBlockID()];
+}
+
+const ExitPathSummary &FunctionAnalysis::getExitPathSummary() {
+  if (ExitPaths) {
+    return *ExitPaths;
+  }
+  assert(getCFG() && "The exit path summary requires a CFG");
+  ExitPaths = std::make_unique<ExitPathSummary>();
+  const auto &ExitBlock = getCFG()->getExit();
+
+  // The blocks which leave the function: the exit block and its predecessors
+  // that interrupt the function themselves.
+  llvm::SmallSetVector<const CFGBlock *, 8> Frontier;
+  Frontier.insert(&ExitBlock);
+  for (const CFGBlock *Block : ExitBlock.preds()) {
+    if (!Block) {
+      ExitPaths->IsComplete = false;
+      return *ExitPaths;
+    }
+    if (getBlockSummary(Block).IsInterruption) {
+      Frontier.insert(Block);
+    }
+  }
+
+  for (const auto *Block : Frontier) {
+    for (const CFGBlock *BlockPred : Block->preds()) {
+      if (BlockPred) {
+        ExitPaths->Blocks.push_back(BlockPred);
+      }
+    }
+  }
+  return *ExitPaths;
+}
+
+StmtWeight FunctionAnalysis::getStmtWeight(const Stmt *S,
+                                           FunctionAnalysisManager &Analyses) {
+  if (!AreWeightsComputed) {
+    AreWeightsComputed = true;
+    if (const auto *Body = Function->getBody()) {
+      computeStmtWeights(Body, Analyses);
+    }
+  }
+  // E.g. the statements of a lambda are not children of the body.
+  auto Iter = Weights.find(S);
+  if (Iter == Weights.end()) {
+    computeStmtWeights(S, Analyses);
+    Iter = Weights.find(S);
+  }
+  return Iter->second;
+}
+
+void FunctionAnalysis::computeStmtWeights(const Stmt *Root,
+                                          FunctionAnalysisManager &Analyses) {
+  const auto &Manager = Context.getSourceManager();
+
+  // A statement is done when all its children are, its parent is on the top
+  // of the stack then.
+  struct Frame {
+    const Stmt *S;
+    Stmt::const_child_iterator NextChild;
+  };
+  SmallVector<Frame, 32> Stack;
+  Stack.push_back({Root, Root->child_begin()});
+  while (!Stack.empty()) {
+    auto &Top = Stack.back();
+    if (Top.NextChild != Top.S->child_end()) {
+      const auto *Child = *Top.NextChild++;
+      if (Child) {
+        Stack.push_back({Child, Child->child_begin()});
+      }
+      continue;
+    }
+
+    auto Done = Stack.pop_back_val();
+    const auto *Parent = Stack.empty() ? nullptr : Stack.back().S;
+
+    bool IsBranch = false;
+    if (const auto *If = dyn_cast_or_null<IfStmt>(Parent)) {
+      IsBranch = If->getThen() == Done.S || If->getElse() == Done.S;
+    }
+    if (Parent && !IsBranch && !isa<CompoundStmt>(Done.S)) {
+      continue;
+    }
+    auto Range = Manager.getExpansionRange(Done.S->getSourceRange());
+    Weights[Done.S] = {
+        Analyses.getExpansionLineNumber(Range.getEnd(), Manager) -
+        Analyses.getExpansionLineNumber(Range.getBegin(), Manager)};
+  }
+}
+
+FunctionAnalysis &
+FunctionAnalysisManager::getAnalysis(const FunctionDecl *Function,
+                                     ASTContext &Context) {
+  if (CurrentContext != &Context) {
+    clear();
+    CurrentContext = &Context;
+  }
+
+  auto Iter = Analyses.find(Function);
+  if (Iter != Analyses.end()) {
+    return *Iter->second;
+  }
+
+  // The checks ask for a function while its declaration is matched and are
+  // done with it before the next one is matched, so only the oldest
+  // analyses are evicted when the cache is full, never the current one.
+  if (MaxCachedFunctions != 0) {
+    while (Analyses.size() >= MaxCachedFunctions) {
+      Analyses.erase(RequestOrder.front());
+      RequestOrder.pop_front();
+    }
+    RequestOrder.push_back(Function);
+  }
+  auto &Analysis = Analyses[Function];
+  Analysis = std::make_unique<FunctionAnalysis>(Function, Context);
+  return *Analysis;
+}
+
+void FunctionAnalysisManager::clear() {
+  Analyses.clear();
+  RequestOrder.clear();
+  CurrentContext = nullptr;
+  LineTables.clear();
+  TokenIndexes.clear();
+  CurrentSourceManager = nullptr;
+}
+
+FunctionAnalysisManager::FunctionAnalysisManager(
+    const ClangTidyOptions::OptionMap &CheckOptions) {
+  readOptions(CheckOptions);
+}
+
+void FunctionAnalysisManager::readOptions(
+    const ClangTidyOptions::OptionMap &CheckOptions) {
+  MaxCachedFunctions = 0;
+  auto Iter = CheckOptions.find("MaxCachedFunctions");
+  if (Iter != CheckOptions.end() &&
+      StringRef(Iter->getValue().Value).getAsInteger(10, MaxCachedFunctions)) {
+    MaxCachedFunctions = 0;
+  }
+}
+
+void FunctionAnalysisManager::switchSourceManager(
+    const SourceManager &Manager) {
+  if (CurrentSourceManager != &Manager) {
+    LineTables.clear();
+    TokenIndexes.clear();
+    CurrentSourceManager = &Manager;
+  }
+}
+
+const SourceLineTable &
+FunctionAnalysisManager::getLineTable(FileID File,
+                                      const SourceManager &Manager) {
+  switchSourceManager(Manager);
+
+  auto &Table = LineTables[File];
+  if (!Table) {
+    bool Invalid = false;
+    auto Buffer = Manager.getBufferData(File, &Invalid);
+    Table = std::make_unique<SourceLineTable>(Invalid ? StringRef() : Buffer);
+  }
+  return *Table;
+}
+
+StringRef
+FunctionAnalysisManager::getIndentationForLine(SourceLocation Loc,
+                                               const SourceManager &Manager) {
+  if (Loc.isInvalid() || Loc.isMacroID()) {
+    return {};
+  }
+  auto [File, Offset] = Manager.getDecomposedLoc(Loc);
+  if (File.isInvalid()) {
+    return {};
+  }
+  return getLineTable(File, Manager).getIndentation(Offset);
+}
+
+unsigned
+FunctionAnalysisManager::getExpansionLineNumber(SourceLocation Loc,
+                                                const SourceManager &Manager) {
+  auto [File, Offset] = Manager.getDecomposedExpansionLoc(Loc);
+  if (File.isInvalid()) {
+    return 0;
+  }
+  return getLineTable(File, Manager).getLineNumber(Offset);
+}
+
+const SourceTokenIndex &
+FunctionAnalysisManager::getTokenIndex(FileID File,
+                                       const ASTContext &Context) {
+  const auto &Manager = Context.getSourceManager();
+  switchSourceManager(Manager);
+
+  auto &Index = TokenIndexes[File];
+  if (!Index) {
+    Index = std::make_unique<SourceTokenIndex>(File, Manager,
+                                               Context.getLangOpts());
+  }
+  return *Index;
+}
+
+unsigned
+FunctionAnalysisManager::measureTokenLength(SourceLocation Loc,
+                                            const ASTContext &Context) {
+  const auto &Manager = Context.getSourceManager();
+  auto [File, Offset] = Manager.getDecomposedExpansionLoc(Loc);
+  if (File.isValid()) {
+    if (const auto *Token = getTokenIndex(File, Context).getTokenAt(Offset)) {
+      return Token->Length;
+    }
+  }
+  return Lexer::MeasureTokenLength(Loc, Manager, Context.getLangOpts());
+}
+
+SourceLocation
+FunctionAnalysisManager::getLocForEndOfToken(SourceLocation Loc,
+                                             const ASTContext &Context) {
+  if (Loc.isInvalid() || Loc.isMacroID()) {
+    return Lexer::getLocForEndOfToken(Loc, 0, Context.getSourceManager(),
+                                      Context.getLangOpts());
+  }
+  auto Length = measureTokenLength(Loc, Context);
+  return Length == 0 ? Loc : Loc.getLocWithOffset(Length);
+}
+
+SourceLocation
+FunctionAnalysisManager::findLocationAfterToken(SourceLocation Loc,
+                                                tok::TokenKind Kind,
+                                                const ASTContext &Context) {
+  const auto &Manager = Context.getSourceManager();
+  if (Loc.isValid() && Loc.isFileID()) {
+    auto [File, Offset] = Manager.getDecomposedLoc(Loc);
+    const auto *Token = getTokenIndex(File, Context).getTokenAfter(Offset);
+    if (Token) {
+      if (Token->Kind != Kind) {
+        return {};
+      }
+      return Manager.getComposedLoc(File, Token->Offset + Token->Length);
+    }
+  }
+  return Lexer::findLocationAfterToken(Loc, Kind, Manager,
+                                       Context.getLangOpts(), false);
+}
+
+CharSourceRange
+FunctionAnalysisManager::makeFileCharRange(CharSourceRange Range,
+                                           const ASTContext &Context) {
+  const auto &Manager = Context.getSourceManager();
+  auto Begin = Range.getBegin();
+  auto End = Range.getEnd();
+  if (Begin.isInvalid() || End.isInvalid() || !Begin.isFileID() ||
+      !End.isFileID()) {
+    return Lexer::makeFileCharRange(Range, Manager, Context.getLangOpts());
+  }
+
+  if (Range.isTokenRange()) {
+    End = getLocForEndOfToken(End, Context);
+  }
+  auto [File, BeginOffset] = Manager.getDecomposedLoc(Begin);
+  unsigned EndOffset = 0;
+  if (File.isInvalid() || !Manager.isInFileID(End, File, &EndOffset) ||
+      BeginOffset > EndOffset) {
+    return {};
+  }
+  return CharSourceRange::getCharRange(Begin, End);
+}
+
+StringRef FunctionAnalysisManager::getSourceText(CharSourceRange Range,
+                                                 const ASTContext &Context) {
+  auto FileRange = makeFileCharRange(Range, Context);
+  if (FileRange.isInvalid()) {
+    return {};
+  }
+  return Lexer::getSourceText(FileRange, Context.getSourceManager(),
+                              Context.getLangOpts());
+}
@@ -0,0 +1,227 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_FUNCTIONANALYSISMANAGER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_FUNCTIONANALYSISMANAGER_H
+
+#include "../ClangTidyOptions.h"
+#include "CFGBlockReachability.h"
+#include "SourceLineTable.h"
+#include "SourceTokenIndex.h"
+#include "clang/AST/Stmt.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/TokenKinds.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSet.h"
+#include <deque>
+#include <memory>
+
+namespace clang {
+class ASTContext;
+class CFG;
+class CFGBlock;
+class CFGStmtMap;
+class FunctionDecl;
+class ParentMap;
+class SourceManager;
+} // namespace clang
+
+namespace clang::tidy::autorefactorings {
+
+/// Statements of a function body which the checks of the module work on. They
+/// are collected in a single traversal of the body shared by all checks.
+struct FunctionCandidates {
+  // All IfStmts in source order.
+  llvm::SmallVector<IfStmt *> IfStmts;
+  // The same IfStmts, but nested ones come before the enclosing ones.
+  llvm::SmallVector<IfStmt *> IfStmtsInnerFirst;
+  // IfStmts which are the else branch of another IfStmt.
+  llvm::SmallPtrSet<const IfStmt *, 8> ElseIfStmts;
+  llvm::SmallVector<GotoStmt *> GotoStmts;
+  // A cheap estimation of the number of CFG blocks of the function, made
+  // without building the CFG. It counts only the blocks that the branching
+  // statements always create.
+  unsigned EstimatedCFGBlocks = 2;
+};
+
+/// Properties of a CFG block which the checks query again and again. They are
+/// computed once for every block of the CFG.
+struct CFGBlockSummary {
+  // Whether the block has elements that are not statements.
+  bool HasNonStmtElements = false;
+  // The expansion range covered by the statements of the block, invalid if
+  // the block is empty.
+  SourceLocation Begin;
+  SourceLocation End;
+  // See Utils::isOnlyReturnBlock.
+  bool IsOnlyReturn = false;
+  // See Utils::isOnlyIterruptionBlock.
+  bool IsInterruption = false;
+  // See Utils::getInterruptStatement, null for an empty block.
+  const Stmt *InterruptStmt = nullptr;
+
+  /// Whether all statements of the block belong to the statement, see
+  /// Utils::isBlockInCurrentStmt.
+  bool isInStmt(const Stmt *CurrentStmt) const {
+    if (HasNonStmtElements) {
+      return false;
+    }
+    return Begin.isInvalid() || (!(CurrentStmt->getBeginLoc() > Begin) &&
+                                 !(CurrentStmt->getEndLoc() < End));
+  }
+};
+
+/// The blocks through which a function body is left: the predecessors of the
+/// exit block and of the blocks that only return from the function.
+struct ExitPathSummary {
+  // False if the exit block has a pruned predecessor, then no block can be
+  // proven to be the only way out.
+  bool IsComplete = true;
+  llvm::SmallVector<const CFGBlock *> Blocks;
+};
+
+/// The size of a statement with everything nested in it.
+struct StmtWeight {
+  // The number of lines between the first and the last line of the statement.
+  unsigned LineSpan = 0;
+};
+
+class FunctionAnalysisManager;
+
+/// Analyses of a single function body. Every analysis is built lazily on the
+/// first request and is shared by all checks of the module.
+class FunctionAnalysis {
+public:
+  FunctionAnalysis(const FunctionDecl *Function, ASTContext &Context);
+  ~FunctionAnalysis();
+
+  const FunctionDecl *getFunction() const { return Function; }
+
+  const FunctionCandidates &getCandidates();
+
+  /// The names declared or referenced in the function, the parameters and
+  /// the members used through an implicit this included.
+  const llvm::StringSet<> &getIdentifiers();
+
+  /// Returns nullptr if the CFG can not be built for the function. The other
+  /// CFG based analyses may be requested only if the CFG exists.
+  clang::CFG *getCFG();
+
+  /// Whether the CFG of the function has more than MaxBlocks blocks. If the
+  /// estimation of the prescan already exceeds the limit, the CFG is not
+  /// built at all.
+  bool exceedsCFGLimit(unsigned MaxBlocks);
+
+  ParentMap &getParentMap();
+  const clang::CFGStmtMap &getStmtMap();
+  /// The first request decides whether the reachability of a CFG with up to
+  /// MaxDenseBlocks blocks is computed at once.
+  CFGBlockReachability &getReachability(unsigned MaxDenseBlocks);
+  /// The summary of a block of the CFG of the function.
+  const CFGBlockSummary &getBlockSummary(const CFGBlock *Block);
+  const ExitPathSummary &getExitPathSummary();
+  /// The weight of a compound statement or of a branch of an IfStmt of the
+  /// function. The weights of all of them are computed in one bottom-up pass
+  /// on the first request. The weight is returned by value, as a request may
+  /// add the weights of statements outside the body to the map.
+  StmtWeight getStmtWeight(const Stmt *S, FunctionAnalysisManager &Analyses);
+
+private:
+  void computeStmtWeights(const Stmt *Root, FunctionAnalysisManager &Analyses);
+
+  const FunctionDecl *Function;
+  ASTContext &Context;
+
+  std::unique_ptr<FunctionCandidates> Candidates;
+  std::unique_ptr<llvm::StringSet<>> Identifiers;
+
+  bool IsCFGBuilt = false;
+  std::unique_ptr<clang::CFG> Cfg;
+  std::unique_ptr<ParentMap> PMap;
+  std::unique_ptr<clang::CFGStmtMap> StmtToBlockMap;
+  std::unique_ptr<CFGBlockReachability> Reachability;
+  // Indexed by the block ID, empty until the first request.
+  llvm::SmallVector<CFGBlockSummary, 0> BlockSummaries;
+  std::unique_ptr<ExitPathSummary> ExitPaths;
+  bool AreWeightsComputed = false;
+  llvm::DenseMap<const Stmt *, StmtWeight> Weights;
+};
+
+/// A cache of function analyses shared by the checks of the
+/// AutoRefactoringModule created for one ClangTidyContext, so that e.g. the
+/// CFG of a function is built once even if several checks need it. Every
+/// check holds the manager as its Analyses member. It is not synchronized,
+/// the checks of other contexts get managers of their own. It also keeps the line tables and the token indexes of
+/// the files the checks query the source of. The cache is scoped to a
+/// translation unit:
+/// it is dropped when the checks see a new ASTContext and at the end of every
+/// translation unit.
+///
+/// The global option MaxCachedFunctions bounds the number of analyses kept
+/// at a time, 0 (the default) means no limit. It belongs to the manager, not
+/// to any of the checks.
+class FunctionAnalysisManager {
+public:
+  FunctionAnalysisManager() = default;
+  explicit FunctionAnalysisManager(
+      const ClangTidyOptions::OptionMap &CheckOptions);
+
+  FunctionAnalysis &getAnalysis(const FunctionDecl *Function,
+                                ASTContext &Context);
+
+  /// Release all analyses of the current translation unit.
+  void clear();
+
+  /// The number of analyses kept at the moment.
+  size_t getNumCachedAnalyses() const { return Analyses.size(); }
+
+  /// Reads the global options of the manager.
+  void readOptions(const ClangTidyOptions::OptionMap &CheckOptions);
+
+  /// The line table of the file, built on the first request.
+  const SourceLineTable &getLineTable(FileID File,
+                                      const SourceManager &Manager);
+
+  /// The indentation of the line of a file location, an empty string for
+  /// a macro location, see Lexer::getIndentationForLine.
+  StringRef getIndentationForLine(SourceLocation Loc,
+                                  const SourceManager &Manager);
+
+  /// The line number of the expansion location of the location.
+  unsigned getExpansionLineNumber(SourceLocation Loc,
+                                  const SourceManager &Manager);
+
+  /// The token index of the file, built on the first request.
+  const SourceTokenIndex &getTokenIndex(FileID File,
+                                        const ASTContext &Context);
+
+  /// The lexer queries below give the same results as the Lexer functions of
+  /// the same names, but take the tokens from the index whenever possible.
+  unsigned measureTokenLength(SourceLocation Loc, const ASTContext &Context);
+  SourceLocation getLocForEndOfToken(SourceLocation Loc,
+                                     const ASTContext &Context);
+  /// Does not skip the whitespace after the token.
+  SourceLocation findLocationAfterToken(SourceLocation Loc,
+                                        tok::TokenKind Kind,
+                                        const ASTContext &Context);
+  CharSourceRange makeFileCharRange(CharSourceRange Range,
+                                    const ASTContext &Context);
+  StringRef getSourceText(CharSourceRange Range, const ASTContext &Context);
+
+private:
+  /// Drops the per-file caches if they belong to another source manager.
+  void switchSourceManager(const SourceManager &Manager);
+
+  const ASTContext *CurrentContext = nullptr;
+  const SourceManager *CurrentSourceManager = nullptr;
+  llvm::DenseMap<FileID, std::unique_ptr<SourceLineTable>> LineTables;
+  llvm::DenseMap<FileID, std::unique_ptr<SourceTokenIndex>> TokenIndexes;
+  unsigned MaxCachedFunctions = 0;
+  llvm::DenseMap<const FunctionDecl *, std::unique_ptr<FunctionAnalysis>>
+      Analyses;
+  // The functions of the analyses in the order they were first requested.
+  std::deque<const FunctionDecl *> RequestOrder;
+};
+
+}; // namespace clang::tidy::autorefactorings
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_FUNCTIONANALYSISMANAGER_H
@@ -1,116 +1,288 @@
 #include "GoToReturnChecker.h"
-#include "AutoRefactoringModuleUtils.h"
-#include "clang/AST/ParentMap.h"
-#include "clang/AST/RecursiveASTVisitor.h"
+#include "SourceLineTable.h"
 #include "clang/Analysis/CFG.h"
-#include "clang/Analysis/CFGStmtMap.h"
 #include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include <algorithm>
 
 using namespace clang;
 using namespace clang::ast_matchers;
 using namespace clang::tidy::autorefactorings;
 
-namespace {
+GoToReturnChecker::GoToReturnChecker(StringRef Name, ClangTidyContext *Context)
+    : GoToReturnChecker(Name, Context,
+                        std::make_shared<FunctionAnalysisManager>(
+                            Context->getOptions().CheckOptions)) {}
 
-class GotoVisitor : public RecursiveASTVisitor<GotoVisitor> {
+GoToReturnChecker::GoToReturnChecker(
+    StringRef Name, ClangTidyContext *Context,
+    std::shared_ptr<FunctionAnalysisManager> Analyses)
+    : ClangTidyCheck(Name, Context), Analyses(std::move(Analyses)),
+      MaxCFGBlocks(Options.getLocalOrGlobal("MaxCFGBlocks", 0U)) {}
 
-  GoToReturnChecker *Checker;
-  const MatchFinder::MatchResult &Result;
-  clang::CFG &Cfg;
+void GoToReturnChecker::storeOptions(ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "MaxCFGBlocks", MaxCFGBlocks);
+}
 
-public:
-  GotoVisitor(GoToReturnChecker *Checker,
-              const MatchFinder::MatchResult &Result, clang::CFG &Cfg)
-      : Checker(Checker), Result(Result), Cfg(Cfg) {}
+void GoToReturnChecker::check(const MatchFinder::MatchResult &Result) {
+  const auto *FunctionDecl =
+      Result.Nodes.getNodeAs<clang::FunctionDecl>("functionDecl");
 
-  bool VisitGotoStmt(clang::GotoStmt *CurrentGotoStmt) {
-    Checker->runInternal(CurrentGotoStmt, Result, Cfg);
-    return true;
+  auto &Analysis = Analyses->getAnalysis(FunctionDecl, *Result.Context);
+  // Most functions have no goto at all, their CFG is not needed.
+  if (Analysis.getCandidates().GotoStmts.empty()) {
+    return;
   }
-};
 
-} // namespace
+  if (MaxCFGBlocks != 0 && Analysis.exceedsCFGLimit(MaxCFGBlocks)) {
+    diag(FunctionDecl->getLocation(),
+         "%0 is skipped because its CFG has more than %1 blocks",
+         DiagnosticIDs::Remark)
+        << FunctionDecl << MaxCFGBlocks;
+    return;
+  }
 
-GoToReturnChecker::GoToReturnChecker(StringRef Name, ClangTidyContext *Context)
-    : ClangTidyCheck(Name, Context) {}
+  const auto *Cfg = Analysis.getCFG();
+  if (!Cfg) {
+    return;
+  }
 
-void GoToReturnChecker::check(const MatchFinder::MatchResult &Result) {
-  const auto *FunctionDecl =
-      Result.Nodes.getNodeAs<clang::FunctionDecl>("functionDecl");
+  // Labels are classified once per function, so every goto is fixed with a
+  // lookup and nothing is kept between functions.
+  LabelMap.clear();
+  classifyLabels(Analysis, *Result.Context);
+  if (LabelMap.empty()) {
+    return;
+  }
 
-  auto Cfg = CFG::buildCFG(FunctionDecl, FunctionDecl->getBody(),
-                           Result.Context, CFG::BuildOptions());
+  for (auto *GotoStmt : Analysis.getCandidates().GotoStmts) {
+    runInternal(GotoStmt, Result);
+  }
+  removeUnusedLabels(FunctionDecl, *Result.Context);
+}
 
-  GotoVisitor Visitor(this, Result, *Cfg.get());
-  Visitor.TraverseDecl(const_cast<clang::FunctionDecl *>(FunctionDecl));
+void GoToReturnChecker::onEndOfTranslationUnit() {
+  LabelMap.clear();
+  Analyses->clear();
 }
 
-bool GoToReturnChecker::runInternal(
-    GotoStmt *GotoStmt, const ast_matchers::MatchFinder::MatchResult &Result,
-    clang::CFG &Cfg) {
+void GoToReturnChecker::classifyLabels(FunctionAnalysis &Analysis,
+                                       const ASTContext &Context) {
+  const auto &Cfg = *Analysis.getCFG();
+  const auto ExitBlockID = Cfg.getExit().getBlockID();
 
-  const auto *GotoStmtLabel = GotoStmt->getLabel();
-  const auto *FunctionDecl =
-      Result.Nodes.getNodeAs<clang::FunctionDecl>("functionDecl");
+  for (const auto *Block : Cfg) {
+    const auto *Label = dyn_cast_or_null<LabelStmt>(Block->getLabel());
+    if (!Label) {
+      continue;
+    }
 
-  auto LabelMapIterator = LabelMap.find(GotoStmtLabel->getID());
+    auto &Info = LabelMap[Label->getDecl()];
 
-  if (LabelMapIterator == LabelMap.end()) {
-    LabelMap[GotoStmtLabel->getID()] = false;
-  } else if (!LabelMapIterator->getSecond()) {
-    return false;
-  }
+    // A goto is the terminator of its block, so the block of a label with
+    // only a goto has no elements.
+    if (Block->empty()) {
+      if (const auto *Goto =
+              dyn_cast_or_null<GotoStmt>(Block->getTerminatorStmt())) {
+        Info.Kind = LabelKind::GotoOnly;
+        Info.Target = Goto->getLabel();
+        continue;
+      }
+    }
 
-  if (!GotoStmtLabel || !FunctionDecl) {
-    return false;
-  }
+    if (Block->succ_size() != 1) {
+      continue;
+    }
+    const CFGBlock *Successor = *Block->succ_begin();
+    if (!Successor || Successor->getBlockID() != ExitBlockID) {
+      continue;
+    }
 
-  std::unique_ptr<ParentMap> PMap(new ParentMap(FunctionDecl->getBody()));
-  std::unique_ptr<clang::CFGStmtMap> StmtToBlockMap(
-      clang::CFGStmtMap::Build(&Cfg, PMap.get()));
+    const auto &BlockSummary = Analysis.getBlockSummary(Block);
+    if (!BlockSummary.IsOnlyReturn) {
+      Info.Kind = LabelKind::ExitSuccessor;
+      continue;
+    }
 
-  const auto *GotoStmtBlock = StmtToBlockMap->getBlock(GotoStmt);
-  const auto *GotoStmtLabelStmt = GotoStmtLabel->getStmt();
+    const auto *InterruptStmt = BlockSummary.InterruptStmt;
+    Info.Kind = LabelKind::ReturnOnly;
+    Info.ReturnText = Analyses->getSourceText(
+        clang::CharSourceRange::getTokenRange(InterruptStmt->getSourceRange()),
+        Context);
+  }
+}
 
-  if (!GotoStmtBlock || !GotoStmtLabelStmt) {
-    return false;
+const LabelDecl *GoToReturnChecker::resolveLabel(const LabelDecl *Label) {
+  // The chain is walked once and all of its labels are resolved to its end.
+  SmallVector<const LabelDecl *, 8> Chain;
+  llvm::SmallPtrSet<const LabelDecl *, 8> OnChain;
+  const auto *End = Label;
+  bool IsCycle = false;
+  while (true) {
+    auto Iterator = LabelMap.find(End);
+    if (Iterator == LabelMap.end()) {
+      break;
+    }
+    auto &Info = Iterator->getSecond();
+    if (Info.Resolved) {
+      End = Info.Resolved;
+      break;
+    }
+    if (Info.Kind != LabelKind::GotoOnly || !Info.Target) {
+      Info.Resolved = End;
+      break;
+    }
+    if (!OnChain.insert(End).second) {
+      IsCycle = true;
+      break;
+    }
+    Chain.push_back(End);
+    End = Info.Target;
+  }
+
+  // The gotos into a cycle of GotoOnly labels are left as they are.
+  for (const auto *Link : Chain) {
+    LabelMap[Link].Resolved = IsCycle ? Link : End;
   }
+  return IsCycle ? Label : End;
+}
 
-  const auto *GotoStmtLabelBlock = StmtToBlockMap->getBlock(GotoStmt);
-  const auto *const GotoStmtLabelStmtBlock =
-      StmtToBlockMap->getBlock(GotoStmtLabelStmt);
+bool GoToReturnChecker::runInternal(
+    GotoStmt *GotoStmt, const ast_matchers::MatchFinder::MatchResult &Result) {
 
-  if (!GotoStmtLabelBlock || !GotoStmtLabelStmtBlock) {
+  const auto *GotoStmtLabel = GotoStmt->getLabel();
+  if (!GotoStmtLabel) {
     return false;
   }
 
-  if (!Utils::isOnlyReturnBlock(GotoStmtLabelStmtBlock, Result.SourceManager)) {
+  // The label of a goto that cannot be fixed stays referenced.
+  if (GotoStmt->getBeginLoc().isMacroID() ||
+      GotoStmt->getEndLoc().isMacroID()) {
     return false;
   }
 
-  if (GotoStmtLabelStmtBlock->succ_size() != 1) {
-    return false;
+  const auto *Target = resolveLabel(GotoStmtLabel);
+  auto LabelMapIterator = LabelMap.find(Target);
+  if (LabelMapIterator != LabelMap.end() &&
+      LabelMapIterator->getSecond().Kind == LabelKind::ReturnOnly) {
+    auto Diag =
+        diag(GotoStmt->getBeginLoc(), "It looks like you're using a Goto on a "
+                                      "label with a only Return Statement");
+    Diag << FixItHint::CreateReplacement(
+        GotoStmt->getSourceRange(), LabelMapIterator->getSecond().ReturnText);
+    ++LabelMap[GotoStmtLabel].RemovedReferences;
+    return true;
   }
-  auto GotoStmtLabelStmtBlockSuccesor = *(GotoStmtLabelStmtBlock->succ_begin());
-  if (!GotoStmtLabelStmtBlockSuccesor ||
-      GotoStmtLabelStmtBlockSuccesor->getBlockID() !=
-          Cfg.getExit().getBlockID()) {
+
+  if (Target == GotoStmtLabel) {
     return false;
   }
 
   auto Diag =
       diag(GotoStmt->getBeginLoc(), "It looks like you're using a Goto on a "
-                                    "label with a only Return Statement");
-  const auto *InterruptStmt =
-      Utils::getInterruptStatement(GotoStmtLabelStmtBlock);
+                                    "label with a only Goto Statement");
+  Diag << FixItHint::CreateReplacement(GotoStmt->getLabelLoc(),
+                                       Target->getName());
+  ++LabelMap[GotoStmtLabel].RemovedReferences;
+  --LabelMap[Target].RemovedReferences;
+  return true;
+}
+
+/// The range to remove with the label, the whole line if nothing else is on
+/// it, invalid if the label cannot be removed. A comment after the label is
+/// kept on its line.
+static CharSourceRange getLabelRemovalRange(const LabelStmt *Label,
+                                            FunctionAnalysisManager &Analyses,
+                                            const ASTContext &Context) {
+  auto IdentLoc = Label->getIdentLoc();
+  auto SubStmtLoc = Label->getSubStmt()->getBeginLoc();
+  if (IdentLoc.isMacroID() || SubStmtLoc.isMacroID()) {
+    return {};
+  }
+  auto ColonEnd = Analyses.findLocationAfterToken(IdentLoc, tok::colon,
+                                                  Context);
+  if (ColonEnd.isInvalid()) {
+    return {};
+  }
 
-  const auto ReturnText = clang::Lexer::getSourceText(
-      clang::CharSourceRange::getTokenRange(InterruptStmt->getSourceRange()),
-      *Result.SourceManager, clang::LangOptions());
+  const auto &Manager = Context.getSourceManager();
+  auto File = Manager.getFileID(IdentLoc);
+  const auto &Lines = Analyses.getLineTable(File, Manager);
+  auto IdentOffset = Manager.getFileOffset(IdentLoc);
+  auto Line = Lines.getLineNumber(IdentOffset);
+  if (Lines.getLineNumber(Manager.getFileOffset(SubStmtLoc)) == Line) {
+    return CharSourceRange::getCharRange(IdentLoc, SubStmtLoc);
+  }
 
-  Diag << FixItHint::CreateReplacement(GotoStmt->getSourceRange(), ReturnText);
-  LabelMap[GotoStmtLabel->getID()] = true;
-  return true;
+  auto LineStart = Lines.getLineStart(Line);
+  auto FileStart = Manager.getLocForStartOfFile(File);
+  auto NextLineStart = FileStart.getLocWithOffset(Lines.getLineStart(Line + 1));
+  auto Rest = Analyses.getSourceText(
+      CharSourceRange::getCharRange(ColonEnd, NextLineStart), Context);
+  if (Rest.trim().empty() &&
+      LineStart + Analyses.getIndentationForLine(IdentLoc, Manager).size() ==
+          IdentOffset) {
+    return CharSourceRange::getCharRange(
+        FileStart.getLocWithOffset(LineStart), NextLineStart);
+  }
+  // The rest of the line, e.g. a comment, and its line break stay.
+  auto Blanks = Rest.size() - Rest.ltrim(" \t").size();
+  return CharSourceRange::getCharRange(IdentLoc,
+                                       ColonEnd.getLocWithOffset(Blanks));
+}
+
+void GoToReturnChecker::removeUnusedLabels(const FunctionDecl *Function,
+                                           const ASTContext &Context) {
+  if (llvm::none_of(LabelMap, [](const auto &Entry) {
+        return Entry.getSecond().RemovedReferences > 0;
+      })) {
+    return;
+  }
+
+  // The references are counted in the whole body, as a label whose address
+  // is taken is never removed.
+  llvm::DenseMap<const LabelDecl *, int> References;
+  llvm::SmallPtrSet<const LabelDecl *, 4> AddressTaken;
+  SmallVector<const LabelStmt *, 8> Labels;
+  SmallVector<const Stmt *, 32> Worklist{Function->getBody()};
+  while (!Worklist.empty()) {
+    const auto *S = Worklist.pop_back_val();
+    if (const auto *Goto = dyn_cast<GotoStmt>(S)) {
+      ++References[Goto->getLabel()];
+    } else if (const auto *AddrLabel = dyn_cast<AddrLabelExpr>(S)) {
+      AddressTaken.insert(AddrLabel->getLabel());
+    } else if (const auto *Label = dyn_cast<LabelStmt>(S)) {
+      Labels.push_back(Label);
+    }
+    // The children are pushed in reverse, so the labels are found in source
+    // order.
+    auto FirstChild = Worklist.size();
+    for (const auto *Child : S->children()) {
+      if (Child) {
+        Worklist.push_back(Child);
+      }
+    }
+    std::reverse(Worklist.begin() + FirstChild, Worklist.end());
+  }
+
+  for (const auto *Label : Labels) {
+    const auto *Decl = Label->getDecl();
+    auto LabelMapIterator = LabelMap.find(Decl);
+    if (LabelMapIterator == LabelMap.end()) {
+      continue;
+    }
+    auto Removed = LabelMapIterator->getSecond().RemovedReferences;
+    if (Removed <= 0 || References.lookup(Decl) != Removed ||
+        AddressTaken.count(Decl) || Decl->isMSAsmLabel()) {
+      continue;
+    }
+    auto Range = getLabelRemovalRange(Label, *Analyses, Context);
+    if (Range.isInvalid()) {
+      continue;
+    }
+    diag(Label->getIdentLoc(), "It looks like label %0 is no longer used")
+        << Decl << FixItHint::CreateRemoval(Range);
+  }
 }
 
 void GoToReturnChecker::registerMatchers(MatchFinder *Finder) {
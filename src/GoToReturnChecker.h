@@ -2,10 +2,10 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_GOTORETURNCHECKER_H
 
 #include "../ClangTidyCheck.h"
+#include "FunctionAnalysisManager.h"
 
 namespace clang {
 class CFG;
-class CFGStmtMap;
 } // namespace clang
 
 namespace clang::tidy::autorefactorings {
@@ -13,17 +13,64 @@ namespace clang::tidy::autorefactorings {
 class GoToReturnChecker : public ClangTidyCheck {
 public:
   GoToReturnChecker(StringRef Name, ClangTidyContext *Context);
+  GoToReturnChecker(StringRef Name, ClangTidyContext *Context,
+                    std::shared_ptr<FunctionAnalysisManager> Analyses);
   bool isLanguageVersionSupported(const LangOptions &LangOpts) const override {
     return true;
   }
+  void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
   bool runInternal(GotoStmt *GotoStmt,
-                   const ast_matchers::MatchFinder::MatchResult &Result,
-                   clang::CFG &Cfg);
+                   const ast_matchers::MatchFinder::MatchResult &Result);
   void registerMatchers(ast_matchers::MatchFinder *Finder) override;
   void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
-  using GotoLabelMap = llvm::DenseMap<int64_t, bool>;
+  void onEndOfTranslationUnit() override;
+
+  /// What the block started by a label does.
+  enum class LabelKind {
+    // The block contains only a ReturnStmt which flows to the exit block.
+    ReturnOnly,
+    // The block flows directly to the exit block, but does something else
+    // before it.
+    ExitSuccessor,
+    // The block contains only a GotoStmt.
+    GotoOnly,
+    Other
+  };
+
+  struct LabelInfo {
+    LabelKind Kind = LabelKind::Other;
+    // The source text of the ReturnStmt of a ReturnOnly label.
+    StringRef ReturnText;
+    // The label the GotoStmt of a GotoOnly label jumps to.
+    const LabelDecl *Target = nullptr;
+    // The label at the end of the chain of GotoOnly labels, null until the
+    // label is resolved.
+    const LabelDecl *Resolved = nullptr;
+    // The number of gotos to the label that are rewritten minus the number
+    // of gotos that are redirected to it.
+    int RemovedReferences = 0;
+  };
+
+  using GotoLabelMap = llvm::DenseMap<const LabelDecl *, LabelInfo>;
 
 private:
+  /// Classify every label of the function in a single walk over its CFG.
+  void classifyLabels(FunctionAnalysis &Analysis, const ASTContext &Context);
+
+  /// The label a goto to the label ends up at, following the chain of
+  /// GotoOnly labels. The result is memoized for every label of the chain.
+  const LabelDecl *resolveLabel(const LabelDecl *Label);
+
+  /// Removes the labels whose gotos are all rewritten.
+  void removeUnusedLabels(const FunctionDecl *Function,
+                          const ASTContext &Context);
+
+  std::shared_ptr<FunctionAnalysisManager> Analyses;
+
+  // Functions whose CFG has more blocks are skipped, 0 means no limit.
+  unsigned MaxCFGBlocks = 0;
+
+  // Labels of the function being checked, rebuilt for every function.
   GotoLabelMap LabelMap;
 };
 }; // namespace clang::tidy::autorefactorings
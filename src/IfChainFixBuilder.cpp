@@ -0,0 +1,195 @@
+#include "IfChainFixBuilder.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/StmtCXX.h"
+#include "clang/Basic/SourceManager.h"
+
+using namespace clang;
+using namespace clang::tidy::autorefactorings;
+
+/// The innermost statement whose last token is the last token of S.
+static const Stmt *getTrailingStmt(const Stmt *S) {
+  while (true) {
+    if (const auto *If = dyn_cast<IfStmt>(S)) {
+      S = If->getElse() ? If->getElse() : If->getThen();
+    } else if (const auto *While = dyn_cast<WhileStmt>(S)) {
+      S = While->getBody();
+    } else if (const auto *For = dyn_cast<ForStmt>(S)) {
+      S = For->getBody();
+    } else if (const auto *RangeFor = dyn_cast<CXXForRangeStmt>(S)) {
+      S = RangeFor->getBody();
+    } else if (const auto *Switch = dyn_cast<SwitchStmt>(S)) {
+      S = Switch->getBody();
+    } else if (const auto *Label = dyn_cast<LabelStmt>(S)) {
+      S = Label->getSubStmt();
+    } else if (const auto *Case = dyn_cast<SwitchCase>(S)) {
+      S = Case->getSubStmt();
+    } else if (const auto *Attributed = dyn_cast<AttributedStmt>(S)) {
+      S = Attributed->getSubStmt();
+    } else {
+      return S;
+    }
+  }
+}
+
+IfChainFixBuilder::IfChainFixBuilder(const IfStmt *Head,
+                                     FunctionAnalysisManager &Analyses,
+                                     const ASTContext &Context)
+    : Analyses(Analyses), Context(Context) {
+  for (const auto *Link = Head; Link;
+       Link = dyn_cast_or_null<IfStmt>(Link->getElse())) {
+    Links.push_back(Link);
+  }
+  LinkStatements.resize(Links.size());
+  if (Links.size() == 1) {
+    return;
+  }
+
+  const auto *Trailing = getTrailingStmt(Links.back());
+  if (Trailing->getEndLoc().isMacroID()) {
+    return;
+  }
+  if (const auto *Compound = dyn_cast<CompoundStmt>(Trailing)) {
+    ChainEnd = Analyses.getLocForEndOfToken(Compound->getRBracLoc(), Context);
+  } else if (const auto *Null = dyn_cast<NullStmt>(Trailing)) {
+    ChainEnd = Analyses.getLocForEndOfToken(Null->getSemiLoc(), Context);
+  } else {
+    // The semicolon of a statement is not a part of its source range.
+    ChainEnd = Analyses.findLocationAfterToken(Trailing->getEndLoc(),
+                                               tok::semi, Context);
+  }
+
+  // The braces are not moved across preprocessor directives, e.g. into or
+  // out of a conditional region.
+  const auto &Manager = Context.getSourceManager();
+  auto FirstElseIfLoc = Links[1]->getBeginLoc();
+  if (ChainEnd.isInvalid() || !FirstElseIfLoc.isFileID() ||
+      Manager.getFileID(FirstElseIfLoc) != Manager.getFileID(ChainEnd)) {
+    ChainEnd = SourceLocation();
+    return;
+  }
+  const auto &Tokens =
+      Analyses.getTokenIndex(Manager.getFileID(ChainEnd), Context);
+  if (Tokens.hasDirective(Manager.getFileOffset(FirstElseIfLoc),
+                          Manager.getFileOffset(ChainEnd))) {
+    ChainEnd = SourceLocation();
+  }
+}
+
+bool IfChainFixBuilder::canInsertBefore(unsigned Link) const {
+  if (Link == 0) {
+    return true;
+  }
+  const auto &Manager = Context.getSourceManager();
+  auto IfLoc = Links[Link]->getBeginLoc();
+  return ChainEnd.isValid() && IfLoc.isFileID() &&
+         Manager.getFileID(IfLoc) == Manager.getFileID(ChainEnd);
+}
+
+void IfChainFixBuilder::insertBefore(unsigned Link,
+                                     ArrayRef<std::string> Statements) {
+  LinkStatements[Link].assign(Statements.begin(), Statements.end());
+}
+
+void IfChainFixBuilder::takeFixes(SmallVectorImpl<FixItHint> &Fixes) {
+  const auto &Manager = Context.getSourceManager();
+  auto GetIndentation = [&](SourceLocation Loc) {
+    return Analyses.getIndentationForLine(Manager.getExpansionLoc(Loc),
+                                          Manager);
+  };
+
+  // The statements of the head simply go to the lines before it.
+  const auto *Head = Links.front();
+  if (!LinkStatements.front().empty()) {
+    auto Indent = GetIndentation(Head->getBeginLoc());
+    std::string Text;
+    for (const auto &Statement : LinkStatements.front()) {
+      Text += (Indent + Statement + ";\n").str();
+    }
+    Fixes.push_back(FixItHint::CreateInsertion(
+        Head->getBeginLoc().getLocWithOffset(-Indent.size()), Text));
+  }
+
+  SmallVector<unsigned, 4> Enclosed;
+  for (unsigned Link = 1; Link < Links.size(); ++Link) {
+    if (!LinkStatements[Link].empty()) {
+      Enclosed.push_back(Link);
+    }
+  }
+  if (Enclosed.empty()) {
+    return;
+  }
+
+  // One level of indentation is taken from the first branch that is indented
+  // relative to its if. Without one, the lines are left as they are.
+  StringRef Unit;
+  for (const auto *Link : Links) {
+    const auto *Then = dyn_cast<CompoundStmt>(Link->getThen());
+    if (!Then || Then->body_empty()) {
+      continue;
+    }
+    auto IfIndent = GetIndentation(Link->getBeginLoc());
+    auto BodyIndent = GetIndentation(Then->body_front()->getBeginLoc());
+    if (BodyIndent.size() > IfIndent.size() &&
+        BodyIndent.starts_with(IfIndent)) {
+      Unit = BodyIndent.drop_front(IfIndent.size());
+      break;
+    }
+  }
+  auto Repeat = [&](unsigned Count) {
+    std::string Text;
+    for (unsigned I = 0; I < Count; ++I) {
+      Text += Unit;
+    }
+    return Text;
+  };
+
+  auto File = Manager.getFileID(ChainEnd);
+  const auto &Lines = Analyses.getLineTable(File, Manager);
+  auto GetLine = [&](SourceLocation Loc) {
+    return Lines.getLineNumber(Manager.getFileOffset(Loc));
+  };
+
+  // Every line after the if of an enclosed link is indented once more for
+  // every block it is in now. The lines that continue a token or a comment
+  // are left as they are.
+  if (!Unit.empty()) {
+    const auto &Tokens = Analyses.getTokenIndex(File, Context);
+    auto FileStart = Manager.getLocForStartOfFile(File);
+    unsigned Depth = 0;
+    const auto *NextEnclosed = Enclosed.begin();
+    auto LastLine = GetLine(ChainEnd);
+    for (auto Line = GetLine(Links[Enclosed.front()]->getBeginLoc()) + 1;
+         Line <= LastLine; ++Line) {
+      while (NextEnclosed != Enclosed.end() &&
+             GetLine(Links[*NextEnclosed]->getBeginLoc()) < Line) {
+        ++Depth;
+        ++NextEnclosed;
+      }
+      auto Offset = Lines.getLineStart(Line);
+      if (Lines.isBlank(Line) || Tokens.isInsideToken(Offset) ||
+          Tokens.isInsideComment(Offset)) {
+        continue;
+      }
+      Fixes.push_back(FixItHint::CreateInsertion(
+          FileStart.getLocWithOffset(Offset), Repeat(Depth)));
+    }
+  }
+
+  // The block of every enclosed link opens before its if and all of them are
+  // closed after the last token of the chain.
+  std::string Closing;
+  unsigned Depth = 0;
+  for (auto Link : Enclosed) {
+    auto IfLoc = Links[Link]->getBeginLoc();
+    auto Indent = GetIndentation(IfLoc);
+    auto Inner = (Indent + Repeat(++Depth)).str();
+    std::string Text = "{\n";
+    for (const auto &Statement : LinkStatements[Link]) {
+      Text += Inner + Statement + ";\n";
+    }
+    Text += Inner;
+    Fixes.push_back(FixItHint::CreateInsertion(IfLoc, Text));
+    Closing.insert(0, ("\n" + Indent + Repeat(Depth - 1) + "}").str());
+  }
+  Fixes.push_back(FixItHint::CreateInsertion(ChainEnd, Closing));
+}
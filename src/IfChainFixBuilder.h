@@ -0,0 +1,54 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_IFCHAINFIXBUILDER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_IFCHAINFIXBUILDER_H
+
+#include "FunctionAnalysisManager.h"
+#include "clang/Basic/Diagnostic.h"
+#include <string>
+
+namespace clang::tidy::autorefactorings {
+
+/// Builds the fixes that move statements in front of the conditions of an if
+/// statement and of the "else if" statements chained to it. There is no place
+/// for statements between the else and the if of an "else if", so its else
+/// becomes a block around the rest of the chain, which is indented once more.
+///
+/// if (a) {                           if (a) {
+///   x = 1;                             x = 1;
+/// } else if (f()) {  ------------>   } else {
+///   x = 2;                             int var0 = f();
+/// }                                    if (var0) {
+///                                        x = 2;
+///                                      }
+///                                    }
+class IfChainFixBuilder {
+public:
+  IfChainFixBuilder(const IfStmt *Head, FunctionAnalysisManager &Analyses,
+                    const ASTContext &Context);
+
+  /// The if statements of the chain, the head first.
+  ArrayRef<const IfStmt *> getLinks() const { return Links; }
+
+  /// Whether statements can be moved in front of the condition of the link.
+  bool canInsertBefore(unsigned Link) const;
+
+  /// Moves the statements in front of the condition of the link, every one
+  /// on a line of its own. They are given without the trailing semicolon.
+  void insertBefore(unsigned Link, ArrayRef<std::string> Statements);
+
+  /// Appends the fixes of all links.
+  void takeFixes(SmallVectorImpl<FixItHint> &Fixes);
+
+private:
+  FunctionAnalysisManager &Analyses;
+  const ASTContext &Context;
+  SmallVector<const IfStmt *, 4> Links;
+  // The location right after the last token of the chain, invalid if the
+  // chain cannot be enclosed in a block.
+  SourceLocation ChainEnd;
+  // The statements of the links, empty for the links that do not change.
+  SmallVector<SmallVector<std::string, 2>, 4> LinkStatements;
+};
+
+}; // namespace clang::tidy::autorefactorings
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_IFCHAINFIXBUILDER_H
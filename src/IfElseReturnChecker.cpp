@@ -1,12 +1,9 @@
 #include "IfElseReturnChecker.h"
 #include "AutoRefactoringModuleUtils.h"
 #include "clang/AST/ParentMap.h"
-#include "clang/AST/RecursiveASTVisitor.h"
-#include "clang/Analysis/Analyses/CFGReachabilityAnalysis.h"
 #include "clang/Analysis/CFG.h"
 #include "clang/Analysis/CFGStmtMap.h"
 #include "clang/Lex/Preprocessor.h"
-#include <sstream>
 
 using namespace clang;
 using namespace clang::ast_matchers;
@@ -26,63 +23,25 @@ public:
 
   void Endif(SourceLocation Loc, SourceLocation IfLoc) override {
 
-    if (!Manager.isWrittenInSameFile(Loc, IfLoc)) {
+    // No fixes are made in the system headers
+    if (!Manager.isWrittenInSameFile(Loc, IfLoc) ||
+        Manager.isInSystemHeader(Loc)) {
       return;
     }
-    auto &Collection = Collections[Manager.getFileID(Loc)];
-    Collection.emplace_back(SourceRange(Loc, IfLoc));
+    auto DecomposedLoc = Manager.getDecomposedLoc(Loc);
+    auto &Collection = Collections[DecomposedLoc.first];
+    Collection.push_back(DecomposedLoc.second);
+    Collection.push_back(Manager.getFileOffset(IfLoc));
   }
-};
-
-class IfStmtVisitor : public RecursiveASTVisitor<IfStmtVisitor> {
-
-  IfElseReturnChecker *Checker;
-  const MatchFinder::MatchResult &Result;
-  clang::CFG &Cfg;
-
-public:
-  IfStmtVisitor(IfElseReturnChecker *Checker,
-                const MatchFinder::MatchResult &Result, clang::CFG &Cfg)
-      : Checker(Checker), Result(Result), Cfg(Cfg) {}
-
-  bool VisitIfStmt(clang::IfStmt *IfStmt) {
 
-    if (IfStmt->hasElseStorage()) {
-      if (isa<clang::IfStmt>(IfStmt->getElse())) {
-        return true;
-      }
-
-      Checker->runInternal(IfStmt, Result, Cfg);
-      return true;
+  void EndOfMainFile() override {
+    for (auto &Collection : Collections) {
+      llvm::sort(Collection.getSecond());
     }
-    return RecursiveASTVisitor<IfStmtVisitor>::VisitIfStmt(IfStmt);
-  }
-
-  bool TraverseIfStmt(IfStmt *CurrentStmt) {
-    if (!CurrentStmt)
-      return true;
-
-    if (auto *ThenStmt = CurrentStmt->getThen()) {
-      TraverseStmt(ThenStmt);
-    }
-    if (auto *ElseStmt = CurrentStmt->getElse()) {
-      TraverseStmt(ElseStmt);
-    }
-    return VisitIfStmt(CurrentStmt);
   }
 };
-} // namespace
 
-/// It is used to calculate the weight of the Then or Else Compound Stmt of the
-/// main IfStmt,
-// on the basis of which a decision will be made about flipping the if and else
-// bodies
-static int getNodeWeight(const Stmt *Node, clang::SourceManager *Manager) {
-  auto Start = Manager->getExpansionRange(Node->getSourceRange()).getBegin();
-  auto End = Manager->getExpansionRange(Node->getSourceRange()).getEnd();
-  return Manager->getExpansionLineNumber(End) -
-         Manager->getSpellingLineNumber(Start);
-}
+} // namespace
 
 static bool fromMacro(const Stmt *S) { return S->getBeginLoc().isMacroID(); }
 
@@ -92,25 +51,20 @@ static bool isPreproccessorInIf(
   if (fromMacro(IfStmt)) {
     return true;
   }
-  auto BeginIfLocation = IfStmt->getBeginLoc();
-  auto EndIfLocation = IfStmt->getEndLoc();
+  auto BeginIfLocation = Manager.getDecomposedLoc(IfStmt->getBeginLoc());
+  auto EndIfLocation = Manager.getDecomposedExpansionLoc(IfStmt->getEndLoc());
+  if (BeginIfLocation.first != EndIfLocation.first) {
+    return true;
+  }
 
-  auto Iter = Locations.find(Manager.getFileID(BeginIfLocation));
-  if (Iter == Locations.end() || Iter->getSecond().empty()) {
+  auto Iter = Locations.find(BeginIfLocation.first);
+  if (Iter == Locations.end()) {
     return false;
   }
-  auto SourceRanges = Iter->getSecond();
-  for (auto &&Range : SourceRanges) {
-    if ((Range.getBegin() > BeginIfLocation) &&
-        (Range.getBegin() < EndIfLocation)) {
-      return true;
-    }
-    if ((Range.getEnd() > BeginIfLocation) &&
-        (Range.getEnd() < EndIfLocation)) {
-      return true;
-    }
-  }
-  return false;
+  // The first directive after the beginning of the if must be after its end
+  const auto &Offsets = Iter->getSecond();
+  const auto *NextOffset = llvm::upper_bound(Offsets, BeginIfLocation.second);
+  return NextOffset != Offsets.end() && *NextOffset < EndIfLocation.second;
 }
 
 /// When using spaces, it is difficult to understand what Indent is, so the user
@@ -121,10 +75,20 @@ static bool isPreproccessorInIf(
 //   value:           1
 IfElseReturnChecker::IfElseReturnChecker(StringRef Name,
                                          ClangTidyContext *Context)
+    : IfElseReturnChecker(Name, Context,
+                          std::make_shared<FunctionAnalysisManager>(
+                              Context->getOptions().CheckOptions)) {}
+
+IfElseReturnChecker::IfElseReturnChecker(
+    StringRef Name, ClangTidyContext *Context,
+    std::shared_ptr<FunctionAnalysisManager> Analyses)
     : ClangTidyCheck(Name, Context), Indent(Options.get("Indent", 4)),
       NeedShift(Options.get("NeedShift", false)),
       ReverseOnNotUO(Options.get("ReverseOnNotUO", false)),
-      Rewrite(std::make_unique<Rewriter>()) {}
+      MaxCFGBlocks(Options.getLocalOrGlobal("MaxCFGBlocks", 0U)),
+      MaxDenseReachabilityBlocks(
+          Options.getLocalOrGlobal("MaxDenseReachabilityBlocks", 1024U)),
+      Analyses(std::move(Analyses)), Rewrite(std::make_unique<Rewriter>()) {}
 
 void IfElseReturnChecker::registerPPCallbacks(const SourceManager &SM,
                                               Preprocessor *PP,
@@ -159,7 +123,7 @@ static bool isExpectedUnaryLNot(const Expr *E) {
 
 void IfElseReturnChecker::runInternal(
     IfStmt *IfStmt, const ast_matchers::MatchFinder::MatchResult &Result,
-    clang::CFG &Cfg) {
+    FunctionAnalysis &Analysis) {
   auto IfLocation = IfStmt->getBeginLoc();
   auto *const Manager = Result.SourceManager;
   if (Manager->isMacroArgExpansion(IfLocation) ||
@@ -195,23 +159,19 @@ void IfElseReturnChecker::runInternal(
       }
     }
   } else {
-    IsThenFirst =
-        getNodeWeight(ThenStmt, Manager) <= getNodeWeight(ElseStmt, Manager);
+    // The weight of the Then or Else Stmt, on the basis of which a decision is
+    // made about flipping the if and else bodies, is taken from the weights
+    // computed for the whole function.
+    auto ThenLineSpan = Analysis.getStmtWeight(ThenStmt, *Analyses).LineSpan;
+    auto ElseLineSpan = Analysis.getStmtWeight(ElseStmt, *Analyses).LineSpan;
+    IsThenFirst = ThenLineSpan <= ElseLineSpan;
   }
 
   auto *TargetStmt = IsThenFirst ? ThenStmt : ElseStmt;
-  const auto *FunctionDecl =
-      Result.Nodes.getNodeAs<clang::FunctionDecl>("functionDecl");
-
-  std::unique_ptr<ParentMap> PMap(new ParentMap(FunctionDecl->getBody()));
-  std::unique_ptr<clang::CFGStmtMap> StmtToBlockMap(
-      clang::CFGStmtMap::Build(&Cfg, PMap.get()));
-
   auto *Context = Result.Context;
 
   if (NeedShift) {
-    if (!addBlockToStmt(TargetStmt, Cfg, Manager, StmtToBlockMap.get(),
-                        Context)) {
+    if (!addBlockToStmt(TargetStmt, Analysis, Manager, Context)) {
       NeedShift = false;
     }
   }
@@ -230,18 +190,19 @@ void IfElseReturnChecker::runInternal(
       auto ElseLBracLoc = CompoundElseStmt->getLBracLoc();
       auto ElseRBracLoc = CompoundElseStmt->getRBracLoc();
 
-      auto Left =
-          Manager->getExpansionLoc(ElseLBracLoc)
-              .getLocWithOffset(Utils::getTokenLenght(ElseLBracLoc, *Context));
+      auto Left = Manager->getExpansionLoc(ElseLBracLoc)
+                      .getLocWithOffset(
+                          Analyses->measureTokenLength(ElseLBracLoc, *Context));
       auto Right = Manager->getExpansionLoc(ElseRBracLoc).getLocWithOffset(-1);
 
-      auto ElseText = Rewrite->getRewrittenText(
-          CharSourceRange::getTokenRange(Left, Right));
+      auto ElseText =
+          readRewrittenText(CharSourceRange::getTokenRange(Left, Right));
       moveBlock(CompoundElseStmt, ElseText, Indent);
     }
 
     if (auto *CompoundThenStmt = dyn_cast<CompoundStmt>(ThenStmt)) {
-      auto ElseLength = Utils::getTokenLenght(IfStmt->getElseLoc(), *Context);
+      auto ElseLength =
+          Analyses->measureTokenLength(IfStmt->getElseLoc(), *Context);
       clang::SourceRange Range(
           Manager->getExpansionLoc(
               CompoundThenStmt->getRBracLoc().getLocWithOffset(1)),
@@ -254,15 +215,12 @@ void IfElseReturnChecker::runInternal(
     }
   }
 
-  DiagnosticBuilder Diag =
-      diag(IfStmt->getBeginLoc(),
-           "It seems like it makes sense to swap then and else branches.");
-
-  for (auto &&Fix : FixList) {
-
-    Diag << Fix;
-  }
-
+  // The diagnostic is emitted when the whole function is handled, as an
+  // enclosing IfStmt may still take over its fixes.
+  PendingDiags.push_back(
+      {IfStmt, std::move(FixList), Manager->getExpansionLoc(IfLocation),
+       Manager->getExpansionLoc(IfStmt->getEndLoc())});
+  UncoveredDiags.push_back(PendingDiags.size() - 1);
   FixList.clear();
   return;
 }
@@ -271,6 +229,12 @@ void IfElseReturnChecker::storeOptions(ClangTidyOptions::OptionMap &Opts) {
   Options.store(Opts, "Indent", Indent);
   Options.store(Opts, "NeedShift", NeedShift);
   Options.store(Opts, "ReverseOnNotUO", ReverseOnNotUO);
+  Options.store(Opts, "MaxCFGBlocks", MaxCFGBlocks);
+  Options.store(Opts, "MaxDenseReachabilityBlocks", MaxDenseReachabilityBlocks);
+}
+
+static bool isIfElseCandidate(const IfStmt *IfStmt) {
+  return IfStmt->hasElseStorage() && !isa<clang::IfStmt>(IfStmt->getElse());
 }
 
 void IfElseReturnChecker::check(const MatchFinder::MatchResult &Result) {
@@ -282,15 +246,348 @@ void IfElseReturnChecker::check(const MatchFinder::MatchResult &Result) {
   const auto *FunctionDecl =
       Result.Nodes.getNodeAs<clang::FunctionDecl>("functionDecl");
 
-  auto Cfg = CFG::buildCFG(FunctionDecl, FunctionDecl->getBody(),
-                           Result.Context, CFG::BuildOptions());
+  // The CFG and the maps over it do not depend on a particular IfStmt, so they
+  // are built once per function and shared with the other checks.
+  auto &Analysis = Analyses->getAnalysis(FunctionDecl, *Result.Context);
+  const auto &IfStmts = Analysis.getCandidates().IfStmtsInnerFirst;
+  if (llvm::none_of(IfStmts, isIfElseCandidate)) {
+    return;
+  }
 
-  IfStmtVisitor Visitor(this, Result, *Cfg.get());
-  Visitor.TraverseDecl(const_cast<clang::FunctionDecl *>(FunctionDecl));
+  // The CFG is only needed to find the block that interrupts a shifted branch.
+  if (NeedShift) {
+    if (MaxCFGBlocks != 0 && Analysis.exceedsCFGLimit(MaxCFGBlocks)) {
+      diag(FunctionDecl->getLocation(),
+           "%0 is skipped because its CFG has more than %1 blocks",
+           DiagnosticIDs::Remark)
+          << FunctionDecl << MaxCFGBlocks;
+      return;
+    }
+    if (!Analysis.getCFG()) {
+      return;
+    }
+  }
+
+  escapeFragmentMarkers(FunctionDecl, *Result.Context);
+
+  // Nested IfStmts are handled before the enclosing ones, so that the
+  // rewriter already contains their changes when the outer one is reversed.
+  for (auto *IfStmt : IfStmts) {
+    if (isIfElseCandidate(IfStmt)) {
+      runInternal(IfStmt, Result, Analysis);
+    }
+  }
+
+  for (auto &Pending : PendingDiags) {
+    DiagnosticBuilder Diag =
+        diag(Pending.IfStmtNode->getBeginLoc(),
+             "It seems like it makes sense to swap then and else branches.");
+    // The changes are already part of the fixes of an enclosing IfStmt,
+    // which would conflict with these ones.
+    if (Pending.Covered) {
+      continue;
+    }
+    for (auto &&Fix : Pending.Fixes) {
+      Fix.CodeToInsert = expandFragments(Fix.CodeToInsert);
+      Diag << Fix;
+    }
+  }
+  PendingDiags.clear();
+  UncoveredDiags.clear();
+
+  // The changes of a function do not affect the text of the other ones, so
+  // the rewriter is released as soon as the fixes are emitted.
+  FixList.clear();
+  Fragments.clear();
+  FragmentArena.Reset();
+  Rewrite = std::make_unique<Rewriter>();
+}
+
+void IfElseReturnChecker::onEndOfTranslationUnit() {
+  PPConditionals.clear();
+  Analyses->clear();
+}
+
+static constexpr char FragmentBegin = '\x01';
+static constexpr char FragmentEnd = '\x02';
+
+StringRef IfElseReturnChecker::readRewrittenText(CharSourceRange Range) {
+  // IfStmts are handled inner first and the else branch is read before the
+  // then branch, so the IfStmts inside the range are the latest ones.
+  while (!UncoveredDiags.empty()) {
+    auto &Pending = PendingDiags[UncoveredDiags.back()];
+    if (Pending.Begin < Range.getBegin() || Range.getEnd() < Pending.End) {
+      break;
+    }
+    Pending.Covered = true;
+    UncoveredDiags.pop_back();
+  }
+  return StringRef(Rewrite->getRewrittenText(Range)).copy(FragmentArena);
+}
+
+static std::string makeFragmentReference(unsigned ID) {
+  return FragmentBegin + std::to_string(ID) + FragmentEnd;
+}
+
+std::string IfElseReturnChecker::makeFragment(StringRef Text) {
+  Fragments.push_back({Text});
+  return makeFragmentReference(Fragments.size() - 1);
+}
+
+void IfElseReturnChecker::escapeFragmentMarkers(const FunctionDecl *Function,
+                                                const ASTContext &Context) {
+  auto Range = Analyses->makeFileCharRange(
+      CharSourceRange::getTokenRange(Function->getSourceRange()), Context);
+  if (Range.isInvalid()) {
+    return;
+  }
+  // The marker bytes of the source are replaced by references to literal
+  // fragments, so every marker read from the rewriter is one of ours.
+  const StringRef Markers("\x01\x02", 2);
+  auto Text = Analyses->getSourceText(Range, Context);
+  for (auto Pos = Text.find_first_of(Markers); Pos != StringRef::npos;
+       Pos = Text.find_first_of(Markers, Pos + 1)) {
+    Fragments.push_back({Text.substr(Pos, 1), 0, /*IsLiteral=*/true});
+    Rewrite->ReplaceText(Range.getBegin().getLocWithOffset(Pos), 1,
+                         makeFragmentReference(Fragments.size() - 1));
+  }
+}
+
+/// Finds the first fragment reference in the text starting at Pos. Begin and
+/// End are set to the positions of its markers. A marker that does not start
+/// a well-formed reference to one of the NumFragments fragments is skipped.
+static bool findFragment(StringRef Text, size_t Pos, unsigned NumFragments,
+                         size_t &Begin, size_t &End, unsigned &ID) {
+  for (Begin = Text.find(FragmentBegin, Pos); Begin != StringRef::npos;
+       Begin = Text.find(FragmentBegin, Begin + 1)) {
+    End = Text.find(FragmentEnd, Begin);
+    if (End != StringRef::npos &&
+        !Text.slice(Begin + 1, End).getAsInteger(10, ID) &&
+        ID < NumFragments) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Functor>
+static void forEachFragment(StringRef Text, unsigned NumFragments,
+                            Functor Func) {
+  size_t Begin = 0;
+  size_t End = 0;
+  unsigned ID = 0;
+  for (size_t Pos = 0; findFragment(Text, Pos, NumFragments, Begin, End, ID);
+       Pos = End + 1) {
+    Func(ID);
+  }
+}
+
+void IfElseReturnChecker::appendExpanded(
+    StringRef Text, unsigned Shifts, bool KeepLiterals, std::string &Out,
+    SmallVectorImpl<std::pair<size_t, unsigned>> &LineShifts) const {
+  // Every frame holds the rest of a text whose expansion is interrupted by a
+  // referenced fragment, so the nesting of the fragments takes no native
+  // stack.
+  struct Frame {
+    StringRef Text;
+    unsigned Shifts;
+  };
+  SmallVector<Frame, 8> Stack{{Text, Shifts}};
+  while (!Stack.empty()) {
+    auto &Top = Stack.back();
+    size_t Begin = 0;
+    size_t End = 0;
+    unsigned ID = 0;
+    bool Found = findFragment(Top.Text, 0, Fragments.size(), Begin, End, ID);
+    auto Chunk = Top.Text.take_front(Found ? Begin : StringRef::npos);
+    if (Top.Shifts != 0) {
+      for (auto NewLine = Chunk.find('\n'); NewLine != StringRef::npos;
+           NewLine = Chunk.find('\n', NewLine + 1)) {
+        LineShifts.emplace_back(Out.size() + NewLine + 1, Top.Shifts);
+      }
+    }
+    Out.append(Chunk.data(), Chunk.size());
+    if (!Found) {
+      Stack.pop_back();
+      continue;
+    }
+
+    const auto &Fragment = Fragments[ID];
+    auto Reference = Top.Text.slice(Begin, End + 1);
+    auto FragmentShifts = Top.Shifts + Fragment.Shifts;
+    Top.Text = Top.Text.drop_front(End + 1);
+    if (!Fragment.IsLiteral) {
+      Stack.push_back({Fragment.Text, FragmentShifts});
+    } else if (KeepLiterals) {
+      Out.append(Reference.data(), Reference.size());
+    } else {
+      Out.append(Fragment.Text.data(), Fragment.Text.size());
+    }
+  }
+}
+
+std::string IfElseReturnChecker::expandFragments(StringRef Text,
+                                                 bool KeepLiterals) const {
+  std::string Out;
+  SmallVector<std::pair<size_t, unsigned>> LineShifts;
+  appendExpanded(Text, 0, KeepLiterals, Out, LineShifts);
+  if (LineShifts.empty() || Indent == 0) {
+    return Out;
+  }
+
+  // Shifting a line Shifts times to the left removes Indent characters each
+  // time while at least Indent blanks are left, see shiftLines.
+  std::string Result;
+  Result.reserve(Out.size());
+  size_t Pos = 0;
+  for (auto &&[LineBegin, Shifts] : LineShifts) {
+    Result.append(Out, Pos, LineBegin - Pos);
+    Pos = LineBegin;
+    auto LineEnd = std::min(Out.find('\n', LineBegin), Out.size());
+    auto StringStart = Out.find_first_not_of(" \t", LineBegin);
+    if (StringStart == std::string::npos || StringStart >= LineEnd) {
+      continue;
+    }
+    Pos += std::min<size_t>(Shifts, (StringStart - LineBegin) / Indent) *
+           Indent;
+  }
+  Result.append(Out, Pos);
+  return Result;
+}
+
+bool IfElseReturnChecker::negateCondition(const Expr *Condition,
+                                          const ASTContext &Context) {
+  const auto &Manager = Context.getSourceManager();
+
+  // Text inserted at a location goes after the text inserted there before and
+  // in front of the token replaced there.
+  struct Edit {
+    SourceLocation Loc;
+    std::string Inserted;
+    bool ReplacesToken = false;
+    std::string Replacement;
+  };
+  SmallVector<Edit, 8> Edits;
+  llvm::DenseMap<SourceLocation, unsigned> EditAt;
+  auto GetEdit = [&](SourceLocation Loc) -> Edit & {
+    auto [Iter, Inserted] = EditAt.try_emplace(Loc, Edits.size());
+    if (Inserted) {
+      Edits.push_back({Loc});
+    }
+    return Edits[Iter->second];
+  };
+  auto Insert = [&](SourceLocation Loc, StringRef Text) {
+    GetEdit(Loc).Inserted += Text;
+  };
+  auto Replace = [&](SourceLocation TokenLoc, StringRef Text) {
+    auto &TokenEdit = GetEdit(TokenLoc);
+    TokenEdit.ReplacesToken = true;
+    TokenEdit.Replacement = Text.str();
+  };
+  // The text of a macro argument may be expanded more than once, so it is
+  // never changed.
+  auto GetFileRange = [&](const Expr *E) {
+    if (Manager.isMacroArgExpansion(E->getBeginLoc()) ||
+        Manager.isMacroArgExpansion(E->getEndLoc())) {
+      return CharSourceRange();
+    }
+    return Analyses->makeFileCharRange(
+        CharSourceRange::getTokenRange(E->getSourceRange()), Context);
+  };
+  auto HasFileParens = [](const ParenExpr *Paren) {
+    return Paren && Paren->getLParen().isFileID() &&
+           Paren->getRParen().isFileID();
+  };
+
+  struct Operand {
+    const Expr *E;
+    // The condition itself, its parentheses are not needed without the !.
+    bool IsCondition;
+    // Set for the operands of || that become operands of &&.
+    bool NeedsParens;
+  };
+  SmallVector<Operand, 8> Worklist{{Condition, true, false}};
+  while (!Worklist.empty()) {
+    auto Current = Worklist.pop_back_val();
+    const auto *E = Current.E->IgnoreImpCasts();
+
+    const auto *Paren = dyn_cast<ParenExpr>(E);
+    if (HasFileParens(Paren)) {
+      Worklist.push_back({Paren->getSubExpr(), false, false});
+      continue;
+    }
+
+    const auto *UnaryOp = dyn_cast<UnaryOperator>(E);
+    if (UnaryOp && UnaryOp->getOpcode() == UO_LNot &&
+        UnaryOp->getOperatorLoc().isFileID()) {
+      Replace(UnaryOp->getOperatorLoc(), "");
+      const auto *SubParen =
+          dyn_cast<ParenExpr>(UnaryOp->getSubExpr()->IgnoreImpCasts());
+      if (Current.IsCondition && HasFileParens(SubParen)) {
+        Replace(SubParen->getLParen(), "");
+        Replace(SubParen->getRParen(), "");
+      }
+      continue;
+    }
+
+    const auto *BinaryOp = dyn_cast<BinaryOperator>(E);
+    if (BinaryOp && BinaryOp->getOperatorLoc().isFileID()) {
+      // Comparisons with NaN are false both ways, so floating point ones are
+      // not flipped.
+      if ((BinaryOp->isRelationalOp() || BinaryOp->isEqualityOp()) &&
+          !BinaryOp->getLHS()->getType()->isRealFloatingType() &&
+          !BinaryOp->getRHS()->getType()->isRealFloatingType()) {
+        Replace(BinaryOp->getOperatorLoc(),
+                BinaryOperator::getOpcodeStr(
+                    BinaryOperator::negateComparisonOp(BinaryOp->getOpcode())));
+        continue;
+      }
+      if (isExpectedBinaryOp(BinaryOp)) {
+        bool IsAnd = BinaryOp->getOpcode() == BO_LAnd;
+        if (Current.NeedsParens && IsAnd) {
+          auto Range = GetFileRange(BinaryOp);
+          if (Range.isInvalid()) {
+            return false;
+          }
+          Insert(Range.getBegin(), "(");
+          Insert(Range.getEnd(), ")");
+        }
+        Replace(BinaryOp->getOperatorLoc(), IsAnd ? "||" : "&&");
+        Worklist.push_back({BinaryOp->getRHS(), false, !IsAnd});
+        Worklist.push_back({BinaryOp->getLHS(), false, !IsAnd});
+        continue;
+      }
+    }
+
+    auto Range = GetFileRange(E);
+    if (Range.isInvalid()) {
+      return false;
+    }
+    if (isa<BinaryOperator, ConditionalOperator, BinaryConditionalOperator>(
+            E)) {
+      Insert(Range.getBegin(), "!(");
+      Insert(Range.getEnd(), ")");
+    } else {
+      Insert(Range.getBegin(), "!");
+    }
+  }
+
+  for (auto &Current : Edits) {
+    auto Text = Current.Inserted + Current.Replacement;
+    if (Current.ReplacesToken) {
+      Rewrite->ReplaceText(SourceRange(Current.Loc), Text);
+      FixList.push_back(
+          FixItHint::CreateReplacement(SourceRange(Current.Loc), Text));
+    } else {
+      Rewrite->InsertText(Current.Loc, Text);
+      FixList.push_back(FixItHint::CreateInsertion(Current.Loc, Text));
+    }
+  }
+  return true;
 }
 
 /// if (cond) ----> if (!(cond))
-/// if (x > y) ----> if (x <= y)
+/// if (x > y) ----> if (x <= y) with ReverseOnNotUO
 bool IfElseReturnChecker::reverseCondition(const IfStmt *IfStmt,
                                            const clang::SourceManager *Manager,
                                            const clang::ASTContext *Context) {
@@ -301,6 +598,12 @@ bool IfElseReturnChecker::reverseCondition(const IfStmt *IfStmt,
 
   const auto *Condition = IfStmt->getCond();
   if (const auto *Then = dyn_cast<CompoundStmt>(IfStmt->getThen())) {
+    // The negation is spelled out at once, so that the condition needs no
+    // later simplification.
+    if (ReverseOnNotUO && negateCondition(Condition, *Context)) {
+      return true;
+    }
+
     auto ExpansionBeginLoc = Condition->getBeginLoc();
 
     if (const auto *UnaryCondition = dyn_cast<UnaryOperator>(Condition)) {
@@ -308,7 +611,7 @@ bool IfElseReturnChecker::reverseCondition(const IfStmt *IfStmt,
       if (OpCode == UO_LNot) {
         auto ConditionSourceText = Utils::getSourceText(
             {ExpansionBeginLoc, ExpansionBeginLoc.getLocWithOffset(2)}, Manager,
-            Context);
+            Context, *Analyses);
         if (ConditionSourceText.starts_with("!(")) {
           Rewrite->RemoveText(
               {ExpansionBeginLoc, ExpansionBeginLoc.getLocWithOffset(1)});
@@ -328,9 +631,9 @@ bool IfElseReturnChecker::reverseCondition(const IfStmt *IfStmt,
       }
     }
 
-    SourceLocation ExpansionEndLoc = clang::Lexer::findLocationAfterToken(
+    SourceLocation ExpansionEndLoc = Analyses->findLocationAfterToken(
         Manager->getExpansionLoc(Condition->getEndLoc()), tok::r_paren,
-        *Manager, Context->getLangOpts(), false);
+        *Context);
 
     if (ExpansionEndLoc.isInvalid()) {
       ExpansionEndLoc = Then->getLBracLoc().getLocWithOffset(-1);
@@ -346,34 +649,23 @@ bool IfElseReturnChecker::reverseCondition(const IfStmt *IfStmt,
   return false;
 }
 
-/// We collect all the blocks that are the boundary of the Stmt, starting with
-/// exit. If a block is found that is not included in this Stmt, but is
-/// achievable from it, as well as meaningful, the analysis stops, as this means
-/// that there are execution paths outside the Stmt, which prevents it from
-/// being interrupted in advance with a conservative approach. Otherwise, the
-/// block is returned, which must be tightened to interrupt the desired branch.
-static const clang::CFGBlock *getInterruptBlockForStmt(
-    const clang::CFG &Cfg, const clang::SourceManager *Manager,
-    const Stmt *CurrentStmt, const clang::ASTContext *Context,
-    const clang::CFGStmtMap *StmtToBlockMap) {
-
-  const auto ExitBlock = Cfg.getExit();
-  std::set<const clang::CFGBlock *> Frontier{&ExitBlock};
-
-  for (auto &&Block : ExitBlock.preds()) {
-    if (!Block) {
-      return nullptr;
-    }
-    if (Utils::isOnlyIterruptionBlock(Block, Cfg, Manager)) {
-      Frontier.insert(Block);
-    }
+/// The blocks through which the function is left are collected once per
+/// function, starting with exit. If a block is found that is not included in
+/// this Stmt, but is achievable from it, as well as meaningful, the analysis
+/// stops, as this means that there are execution paths outside the Stmt,
+/// which prevents it from being interrupted in advance with a conservative
+/// approach. Otherwise, the block is returned, which must be tightened to
+/// interrupt the desired branch.
+static const clang::CFGBlock *
+getInterruptBlockForStmt(FunctionAnalysis &Analysis, const Stmt *CurrentStmt,
+                         unsigned MaxDenseReachabilityBlocks) {
+  const auto &Summary = Analysis.getExitPathSummary();
+  if (!Summary.IsComplete) {
+    return nullptr;
   }
 
-  CFGReverseBlockReachabilityAnalysis Analysis(Cfg);
-  const clang::CFGBlock *MBlock = nullptr;
-
   const auto *CmpdStmt = dyn_cast<CompoundStmt>(CurrentStmt);
-  if (!CmpdStmt) {
+  if (!CmpdStmt || CmpdStmt->body_empty()) {
     return nullptr;
   }
 
@@ -382,33 +674,25 @@ static const clang::CFGBlock *getInterruptBlockForStmt(
     return nullptr;
   }
 
-  const auto *FstBlock = StmtToBlockMap->getBlock(FstStmt);
+  const auto *FstBlock = Analysis.getStmtMap().getBlock(FstStmt);
 
   if (!FstBlock) {
     return nullptr;
   }
 
-  for (auto &&Block : Frontier) {
-    if (!Block) {
-      return nullptr;
+  auto &Reachability = Analysis.getReachability(MaxDenseReachabilityBlocks);
+  const clang::CFGBlock *MBlock = nullptr;
+
+  for (const auto *Block : Summary.Blocks) {
+    const auto &BlockSummary = Analysis.getBlockSummary(Block);
+    if (BlockSummary.isInStmt(CurrentStmt) ||
+        !Reachability.isReachable(FstBlock, Block)) {
+      continue;
     }
-    for (auto BlockPred : Block->preds()) {
-      auto IsBlockInCurrentStmt =
-          Utils::isBlockInCurrentStmt(BlockPred, CurrentStmt, Manager);
-      auto CurrentBlockIsReachable = Analysis.isReachable(FstBlock, BlockPred);
-      if (!Utils::isOnlyIterruptionBlock(BlockPred, Cfg, Manager)) {
-        if (!IsBlockInCurrentStmt && CurrentBlockIsReachable) {
-          return nullptr;
-        }
-        continue;
-      }
-      if (!IsBlockInCurrentStmt && CurrentBlockIsReachable) {
-        if (MBlock) {
-          return nullptr;
-        }
-        MBlock = BlockPred;
-      }
+    if (!BlockSummary.IsInterruption || MBlock) {
+      return nullptr;
     }
+    MBlock = Block;
   }
 
   return MBlock;
@@ -424,8 +708,8 @@ void IfElseReturnChecker::appendStmt(const CompoundStmt *CmdStmt,
   auto *LastStmt = CmdStmt->body_back();
 
   // Get source text for new stmt
-  auto StmtToAddSourceText =
-      Utils::getSourceText(StmtToAdd->getSourceRange(), Manager, Context);
+  auto StmtToAddSourceText = Utils::getSourceText(
+      StmtToAdd->getSourceRange(), Manager, Context, *Analyses);
 
   // Get range and location for lastStmt in CompoundStmt
   auto LastStmtRange = LastStmt->getSourceRange();
@@ -433,16 +717,15 @@ void IfElseReturnChecker::appendStmt(const CompoundStmt *CmdStmt,
 
   // Take a transfer for the last stmt to use it to insert a new one
   auto Indent =
-      clang::Lexer::getIndentationForLine(LastStmt->getBeginLoc(), *Manager);
+      Analyses->getIndentationForLine(LastStmt->getBeginLoc(), *Manager);
 
   // You need to insert a new instruction immediately after the last one,
   // so you need to find the place to use ";"
-  SourceLocation SemiLoc(clang::Lexer::findLocationAfterToken(
-      LastTokenLoc, clang::tok::semi, *Manager, Context->getLangOpts(), false));
+  SourceLocation SemiLoc(Analyses->findLocationAfterToken(
+      LastTokenLoc, clang::tok::semi, *Context));
 
   if (SemiLoc.isInvalid()) {
-    SemiLoc = clang::Lexer::getLocForEndOfToken(LastTokenLoc, 0, *Manager,
-                                                Context->getLangOpts());
+    SemiLoc = Analyses->getLocForEndOfToken(LastTokenLoc, *Context);
   }
 
   std::string Text = "\n" + Indent.str() + StmtToAddSourceText.str();
@@ -451,45 +734,76 @@ void IfElseReturnChecker::appendStmt(const CompoundStmt *CmdStmt,
   FixList.push_back(FixItHint::CreateInsertion(SemiLoc, Text));
 }
 
-/// It's not the most efficient way to move a block to the left by the specified
-/// number of characters.
-void IfElseReturnChecker::moveBlock(const CompoundStmt *Stmt,
-                                    const std::string &String,
-                                    unsigned long MainIndent) {
+/// Whether the indentation of a line, or the emptiness of the last line,
+/// depends on the text behind a fragment reference.
+static bool hasIndentationInFragments(StringRef Text) {
+  StringRef Line;
+  while (!Text.empty()) {
+    std::tie(Line, Text) = Text.split('\n');
+    auto StringStart = Line.find_first_not_of(" \t");
+    if (StringStart != StringRef::npos && Line[StringStart] == FragmentBegin) {
+      return true;
+    }
+  }
+  return Line.contains(FragmentBegin);
+}
+
+StringRef IfElseReturnChecker::shiftLines(StringRef String,
+                                          unsigned long MainIndent) {
+  std::string Expanded;
+  if (hasIndentationInFragments(String)) {
+    // The literal fragments stay references, so the markers of the source
+    // are not taken for references below.
+    Expanded = expandFragments(String, /*KeepLiterals=*/true);
+    String = Expanded;
+  }
 
-  std::vector<std::string> Vector{"\n"};
-  std::stringstream Stream(String);
-  std::string Token;
+  // The lines are written to a single buffer, each one after a line break.
+  // The lines are never longer than in the string, and a line break is added
+  // before the first and the last one at most.
+  auto *Buffer = FragmentArena.Allocate<char>(String.size() + 2);
+  size_t Size = 0;
+  Buffer[Size++] = '\n';
+  size_t LastLineBegin = 0;
 
+  StringRef Text = String;
+  StringRef Line;
   bool First = true;
-  while (std::getline(Stream, Token, '\n')) {
-    if (First) {
-      if (Token.empty() || Token.find_first_not_of(" \t") == std::string::npos)
-        continue;
+  while (!Text.empty()) {
+    std::tie(Line, Text) = Text.split('\n');
+    auto StringStart = Line.find_first_not_of(" \t");
+    if (First && StringStart == StringRef::npos) {
+      continue;
     }
     First = false;
-    auto StringStart = Token.find_first_not_of(" \t");
 
-    if (StringStart == std::string::npos || StringStart < MainIndent) {
-      Vector.push_back(Token);
-      continue;
-    }
+    // The lines of the referenced text are shifted when it is expanded
+    forEachFragment(Line, Fragments.size(),
+                    [this](unsigned ID) { Fragments[ID].Shifts += 1; });
 
-    auto TrimToken = Token.erase(0, MainIndent);
-    Vector.push_back(TrimToken);
+    Buffer[Size++] = '\n';
+    LastLineBegin = Size;
+    if (StringStart != StringRef::npos && StringStart >= MainIndent) {
+      Line = Line.drop_front(MainIndent);
+    }
+    llvm::copy(Line, Buffer + Size);
+    Size += Line.size();
   }
 
-  auto LastString = Vector.back();
-  if (LastString.find_first_not_of(" \t") == std::string::npos) {
-    Vector.pop_back();
+  StringRef LastLine(Buffer + LastLineBegin, Size - LastLineBegin);
+  if (LastLineBegin != 0 &&
+      LastLine.find_first_not_of(" \t") == StringRef::npos) {
+    Size = LastLineBegin - 1;
   }
+  return StringRef(Buffer, Size);
+}
 
-  std::stringstream InputStream;
-  copy(Vector.begin(), Vector.end(),
-       std::ostream_iterator<std::string>(InputStream, "\n"));
-
-  auto Text = InputStream.str();
-  Text.pop_back();
+/// The block is replaced by a reference to the shifted text, so the enclosing
+/// IfStmts copy only the reference.
+void IfElseReturnChecker::moveBlock(const CompoundStmt *Stmt,
+                                    StringRef String,
+                                    unsigned long MainIndent) {
+  auto Text = makeFragment(shiftLines(String, MainIndent));
 
   Rewrite->RemoveText(Stmt->getSourceRange());
   Rewrite->InsertText(Stmt->getBeginLoc(), Text);
@@ -535,13 +849,13 @@ void IfElseReturnChecker::reverseStmt(const IfStmt *IfStmt,
   if (!CompoundElseStmt) {
     ElseTokenRange = CharSourceRange::getTokenRange(ThenStmt->getSourceRange());
 
-    auto ElseLenght = Utils::getTokenLenght(IfStmt->getElseLoc(), Context);
+    auto ElseLenght =
+        Analyses->measureTokenLength(IfStmt->getElseLoc(), Context);
     auto ElseStartLocation = IfStmt->getElseLoc().getLocWithOffset(ElseLenght);
     auto ElseEndLocation = IfStmt->getEndLoc();
 
-    SourceLocation SemiLoc(clang::Lexer::findLocationAfterToken(
-        ElseEndLocation, clang::tok::semi, *Manager, Context.getLangOpts(),
-        false));
+    SourceLocation SemiLoc(Analyses->findLocationAfterToken(
+        ElseEndLocation, clang::tok::semi, Context));
 
     if (SemiLoc.isInvalid()) {
       SemiLoc = ElseEndLocation;
@@ -559,20 +873,16 @@ void IfElseReturnChecker::reverseStmt(const IfStmt *IfStmt,
     //             -1);
   }
 
-  auto ElseText = Rewrite->getRewrittenText(ElseTokenRange);
-
-  std::string IfText;
-  if (!NeedShift) {
-    IfText = Rewrite->getRewrittenText(IfTokenRange);
-  } else {
-    IfText = Rewrite->getRewrittenText(
-        getCompoundStmtRange(CompoundIfStmt, Context, Manager, -1));
-  }
+  auto ElseText = makeFragment(readRewrittenText(ElseTokenRange));
 
   if (NeedShift) {
-    moveBlock(CompoundElseStmt, IfText, Indent);
+    moveBlock(CompoundElseStmt,
+              readRewrittenText(
+                  getCompoundStmtRange(CompoundIfStmt, Context, Manager, -1)),
+              Indent);
     if (CompoundIfStmt) {
-      auto ElseLength = Utils::getTokenLenght(IfStmt->getElseLoc(), Context);
+      auto ElseLength =
+          Analyses->measureTokenLength(IfStmt->getElseLoc(), Context);
       clang::SourceRange Range(
           Manager->getExpansionLoc(
               CompoundIfStmt->getRBracLoc().getLocWithOffset(1)),
@@ -585,6 +895,7 @@ void IfElseReturnChecker::reverseStmt(const IfStmt *IfStmt,
       FixList.push_back(FixItHint::CreateRemoval(IfStmt->getElseLoc()));
     }
   } else {
+    auto IfText = makeFragment(readRewrittenText(IfTokenRange));
     Rewrite->ReplaceText(ElseTokenRange, IfText);
     FixList.push_back(FixItHint::CreateReplacement(ElseTokenRange, IfText));
   }
@@ -598,19 +909,19 @@ static bool isInterruptStmt(const Stmt *Stmt) {
 }
 
 bool IfElseReturnChecker::addBlockToStmt(
-    const Stmt *Stmt, const clang::CFG &Cfg,
-    const clang::SourceManager *Manager,
-    const clang::CFGStmtMap *StmtToBlockMap, const clang::ASTContext *Context) {
+    const Stmt *Stmt, FunctionAnalysis &Analysis,
+    const clang::SourceManager *Manager, const clang::ASTContext *Context) {
   if (const auto *LastStmt = Utils::getLastStmt(Stmt)) {
     if (isInterruptStmt(LastStmt)) {
       return true;
     }
   }
 
-  if (const auto *Block = getInterruptBlockForStmt(Cfg, Manager, Stmt, Context,
-                                                   StmtToBlockMap)) {
-    auto *InterruptionBlockStmt = Utils::getInterruptStatement(Block);
-    if (fromMacro(InterruptionBlockStmt)) {
+  if (const auto *Block = getInterruptBlockForStmt(
+          Analysis, Stmt, MaxDenseReachabilityBlocks)) {
+    const auto *InterruptionBlockStmt =
+        Analysis.getBlockSummary(Block).InterruptStmt;
+    if (!InterruptionBlockStmt || fromMacro(InterruptionBlockStmt)) {
       return false;
     }
     appendStmt(dyn_cast<CompoundStmt>(Stmt), InterruptionBlockStmt, Manager,
@@ -2,32 +2,33 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_IFELSERETURNCHECKER_H
 
 #include "../ClangTidyCheck.h"
+#include "FunctionAnalysisManager.h"
 #include "clang/Rewrite/Core/Rewriter.h"
-
-namespace clang {
-class CFG;
-class CFGStmtMap;
-} // namespace clang
+#include "llvm/Support/Allocator.h"
 
 namespace clang::tidy::autorefactorings {
 
 class IfElseReturnChecker : public ClangTidyCheck {
 public:
   IfElseReturnChecker(StringRef Name, ClangTidyContext *Context);
+  IfElseReturnChecker(StringRef Name, ClangTidyContext *Context,
+                      std::shared_ptr<FunctionAnalysisManager> Analyses);
   bool isLanguageVersionSupported(const LangOptions &LangOpts) const override {
     return true;
   }
   void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
   void registerMatchers(ast_matchers::MatchFinder *Finder) override;
   void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
+  void onEndOfTranslationUnit() override;
   void runInternal(IfStmt *IfStmt,
                    const ast_matchers::MatchFinder::MatchResult &Result,
-                   clang::CFG &Cfg);
+                   FunctionAnalysis &Analysis);
 
   void registerPPCallbacks(const SourceManager &SM, Preprocessor *PP,
                            Preprocessor *ModuleExpanderPP) override;
+  /// Sorted offsets of the #if and #endif directives of every file.
   using PreproccessorEndLocations =
-      llvm::DenseMap<FileID, SmallVector<SourceRange>>;
+      llvm::DenseMap<FileID, SmallVector<unsigned>>;
 
 private:
   // The offset required when removing the else block is set by the user in
@@ -40,12 +41,47 @@ private:
 
   bool ReverseOnNotUO{};
 
+  // Functions whose CFG has more blocks are skipped when the CFG is needed,
+  // 0 means no limit.
+  unsigned MaxCFGBlocks = 0;
+
+  // The reachability of CFGs with up to so many blocks is computed at once
+  // as a bit matrix, larger ones are analyzed lazily.
+  unsigned MaxDenseReachabilityBlocks = 1024;
+
+  std::shared_ptr<FunctionAnalysisManager> Analyses;
+
   // A rewriter used to track intermediate changes to implement changes to all
   // IfStmts in one pass when reversining surrounding IfStmts, you need to have
   // information about internal ones
   std::unique_ptr<Rewriter> Rewrite;
   SmallVector<clang::FixItHint> FixList;
 
+  // Text read from the rewriter is stored once and only a reference to it is
+  // written back, so nested reversals do not copy the inner text again.
+  struct RewrittenFragment {
+    StringRef Text;
+    // How many times the lines of the text are to be shifted to the left.
+    unsigned Shifts = 0;
+    // The text is a marker byte of the source, see escapeFragmentMarkers.
+    bool IsLiteral = false;
+  };
+  SmallVector<RewrittenFragment, 0> Fragments;
+  // Holds the text of the fragments, it is reset when a function is done.
+  llvm::BumpPtrAllocator FragmentArena;
+
+  struct PendingDiag {
+    const IfStmt *IfStmtNode;
+    SmallVector<clang::FixItHint> Fixes;
+    SourceLocation Begin;
+    SourceLocation End;
+    // The changes are included in the fixes of an enclosing IfStmt.
+    bool Covered = false;
+  };
+  SmallVector<PendingDiag> PendingDiags;
+  // Indices of the pending diagnostics not yet covered by an enclosing IfStmt.
+  SmallVector<unsigned> UncoveredDiags;
+
   PreproccessorEndLocations PPConditionals;
 
   /// The method required to reverse the ifStmt condition
@@ -56,11 +92,42 @@ private:
   bool reverseCondition(const IfStmt *IfStmt, const SourceManager *Manager,
                         const clang::ASTContext *Context);
 
+  /// Negates the condition in place without wrapping it in !(): the ! operators
+  /// are removed, the comparisons are flipped and the logical operators are
+  /// swapped by De Morgan's laws. Returns false and changes nothing if a part
+  /// of the condition is spelled in a macro argument.
+  bool negateCondition(const Expr *Condition, const ASTContext &Context);
+
   /// Accepts a compound statement and replaces it in the source code with a
   /// string, shifting to the left by indent param.
-  void moveBlock(const CompoundStmt *Stmt, const std::string &String,
+  void moveBlock(const CompoundStmt *Stmt, StringRef String,
                  unsigned long Indent);
 
+  /// Shifts the lines of the string to the left by indent param, the result
+  /// is written to the fragment arena.
+  StringRef shiftLines(StringRef String, unsigned long MainIndent);
+
+  /// Copies the rewritten text of the range to the fragment arena and marks
+  /// the pending diagnostics of the IfStmts inside it as covered.
+  StringRef readRewrittenText(CharSourceRange Range);
+
+  /// Stores the text of the fragment arena as a fragment and returns a
+  /// reference to it.
+  std::string makeFragment(StringRef Text);
+
+  /// Replaces the fragment references in the text with the shifted fragments.
+  /// With KeepLiterals the references to literal fragments are kept.
+  std::string expandFragments(StringRef Text, bool KeepLiterals = false) const;
+
+  void appendExpanded(
+      StringRef Text, unsigned Shifts, bool KeepLiterals, std::string &Out,
+      SmallVectorImpl<std::pair<size_t, unsigned>> &LineShifts) const;
+
+  /// Replaces the fragment marker bytes in the source of the function with
+  /// references to literal fragments in the rewriter.
+  void escapeFragmentMarkers(const FunctionDecl *Function,
+                             const ASTContext &Context);
+
   /// Add stmt to the original stmt, which is used to pull up blocks.
   ///
   /// For example:
@@ -88,10 +155,8 @@ private:
   void reverseStmt(const IfStmt *IfStmt, const ASTContext &Context,
                    const SourceManager *Manager);
 
-  bool addBlockToStmt(const Stmt *Stmt, const clang::CFG &Cfg,
-                      const SourceManager *Manager,
-                      const clang::CFGStmtMap *StmtToBlockMap,
-                      const ASTContext *Context);
+  bool addBlockToStmt(const Stmt *Stmt, FunctionAnalysis &Analysis,
+                      const SourceManager *Manager, const ASTContext *Context);
 };
 }; // namespace clang::tidy::autorefactorings
 
@@ -0,0 +1,84 @@
+#include "SourceLineTable.h"
+#include "llvm/ADT/STLExtras.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace clang::tidy::autorefactorings;
+
+static bool isLineBreak(char C) { return C == '\n' || C == '\r'; }
+
+static bool isHorizontalWhitespace(char C) {
+  return C == ' ' || C == '\t' || C == '\f' || C == '\v';
+}
+
+SourceLineTable::SourceLineTable(llvm::StringRef Buffer) : Buffer(Buffer) {
+  const char *Begin = Buffer.data();
+  const char *End = Begin + Buffer.size();
+  // Most files have only "\n" line breaks, which memchr finds a vector at a
+  // time. The other ones are looked for only if the buffer has any '\r'.
+  bool HasCarriageReturns = Buffer.contains('\r');
+
+  LineStarts.push_back(0);
+  const char *Pos = Begin;
+  while (Pos != End) {
+    const char *Break =
+        HasCarriageReturns
+            ? std::find_if(Pos, End, isLineBreak)
+            : static_cast<const char *>(std::memchr(Pos, '\n', End - Pos));
+    if (!Break || Break == End) {
+      break;
+    }
+    const char *Next = Break + 1;
+    if (*Break == '\r' && Next != End && *Next == '\n') {
+      ++Next;
+    }
+    LineStarts.push_back(Next - Begin);
+    Pos = Next;
+  }
+
+  auto NumLines = LineStarts.size();
+  IndentWidths.resize(NumLines);
+  EndsEscaped.resize(NumLines);
+  for (unsigned I = 0; I < NumLines; ++I) {
+    auto Width = Buffer.drop_front(LineStarts[I]).find_first_not_of(" \t");
+    IndentWidths[I] = Width == llvm::StringRef::npos ? 0 : Width;
+    if (I + 1 == NumLines) {
+      continue;
+    }
+
+    // See Lexer::isNewLineEscaped.
+    size_t Last = LineStarts[I + 1] - 1;
+    if (Last != 0 && isLineBreak(Buffer[Last - 1]) &&
+        Buffer[Last - 1] != Buffer[Last]) {
+      --Last;
+    }
+    if (Last == 0) {
+      continue;
+    }
+    --Last;
+    while (Last != 0 && isHorizontalWhitespace(Buffer[Last])) {
+      --Last;
+    }
+    EndsEscaped[I] = Buffer[Last] == '\\';
+  }
+}
+
+unsigned SourceLineTable::getLineNumber(unsigned Offset) const {
+  return llvm::upper_bound(LineStarts, Offset) - LineStarts.begin();
+}
+
+bool SourceLineTable::isBlank(unsigned Line) const {
+  auto Pos = LineStarts[Line - 1] + IndentWidths[Line - 1];
+  return Pos >= Buffer.size() || isLineBreak(Buffer[Pos]);
+}
+
+llvm::StringRef SourceLineTable::getIndentation(unsigned Offset) const {
+  if (Offset >= Buffer.size()) {
+    return {};
+  }
+  auto Line = getLineNumber(Offset) - 1;
+  while (Line != 0 && EndsEscaped[Line - 1]) {
+    --Line;
+  }
+  return Buffer.substr(LineStarts[Line], IndentWidths[Line]);
+}
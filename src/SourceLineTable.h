@@ -0,0 +1,42 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_SOURCELINETABLE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_SOURCELINETABLE_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace clang::tidy::autorefactorings {
+
+/// The starts of the lines of a file buffer and the widths of their leading
+/// whitespace, computed once for the buffer. Lines are counted like the
+/// SourceManager does, so a "\r\n" pair is a single line break, but "\n\r"
+/// is two.
+class SourceLineTable {
+public:
+  explicit SourceLineTable(llvm::StringRef Buffer);
+
+  /// The 1-based number of the line containing the offset.
+  unsigned getLineNumber(unsigned Offset) const;
+
+  /// The leading whitespace of the logical line containing the offset, with
+  /// the same result as Lexer::getIndentationForLine.
+  llvm::StringRef getIndentation(unsigned Offset) const;
+
+  /// The offset of the start of the 1-based line.
+  unsigned getLineStart(unsigned Line) const { return LineStarts[Line - 1]; }
+
+  /// Whether the 1-based line has nothing but whitespace.
+  bool isBlank(unsigned Line) const;
+
+private:
+  llvm::StringRef Buffer;
+  llvm::SmallVector<unsigned, 0> LineStarts;
+  // The number of leading spaces and tabs of every line, or of the whole
+  // line if it is blank.
+  llvm::SmallVector<unsigned, 0> IndentWidths;
+  // Whether the line break at the end of the line is escaped by a backslash.
+  llvm::SmallVector<bool, 0> EndsEscaped;
+};
+
+}; // namespace clang::tidy::autorefactorings
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_SOURCELINETABLE_H
@@ -0,0 +1,84 @@
+#include "SourceTokenIndex.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+
+using namespace clang;
+using namespace clang::tidy::autorefactorings;
+
+SourceTokenIndex::SourceTokenIndex(FileID File, const SourceManager &Manager,
+                                   const LangOptions &LangOpts) {
+  bool Invalid = false;
+  auto Buffer = Manager.getBufferData(File, &Invalid);
+  if (Invalid) {
+    return;
+  }
+
+  Lexer RawLexer(Manager.getLocForStartOfFile(File), LangOpts, Buffer.begin(),
+                 Buffer.begin(), Buffer.end());
+  RawLexer.SetCommentRetentionState(true);
+  Token Tok;
+  for (RawLexer.LexFromRawLexer(Tok); Tok.isNot(tok::eof);
+       RawLexer.LexFromRawLexer(Tok)) {
+    RawToken Raw{Manager.getFileOffset(Tok.getLocation()), Tok.getLength(),
+                 Tok.getKind()};
+    if (Tok.is(tok::comment)) {
+      Comments.push_back(Raw);
+      continue;
+    }
+    if (Tok.is(tok::hash) && Tok.isAtStartOfLine()) {
+      Directives.push_back(Raw.Offset);
+    }
+    Tokens.push_back(Raw);
+  }
+}
+
+/// Whether the offset is inside one of the sorted tokens but not at its
+/// start.
+static bool
+isInside(llvm::ArrayRef<SourceTokenIndex::RawToken> Tokens, unsigned Offset) {
+  const auto *Iter =
+      llvm::partition_point(Tokens, [Offset](const auto &Token) {
+        return Token.Offset < Offset;
+      });
+  if (Iter == Tokens.begin()) {
+    return false;
+  }
+  --Iter;
+  return Iter->Offset + Iter->Length > Offset;
+}
+
+const SourceTokenIndex::RawToken *
+SourceTokenIndex::getTokenAt(unsigned Offset) const {
+  const auto *Iter =
+      llvm::partition_point(Tokens, [Offset](const RawToken &Token) {
+        return Token.Offset < Offset;
+      });
+  if (Iter == Tokens.end() || Iter->Offset != Offset) {
+    return nullptr;
+  }
+  return Iter;
+}
+
+const SourceTokenIndex::RawToken *
+SourceTokenIndex::getTokenAfter(unsigned Offset) const {
+  const auto *Token = getTokenAt(Offset);
+  if (!Token || Token + 1 == Tokens.end()) {
+    return nullptr;
+  }
+  return Token + 1;
+}
+
+bool SourceTokenIndex::isInsideToken(unsigned Offset) const {
+  return isInside(Tokens, Offset);
+}
+
+bool SourceTokenIndex::isInsideComment(unsigned Offset) const {
+  return isInside(Comments, Offset);
+}
+
+bool SourceTokenIndex::hasDirective(unsigned Begin, unsigned End) const {
+  const auto *Iter = llvm::lower_bound(Directives, Begin);
+  return Iter != Directives.end() && *Iter < End;
+}
@@ -0,0 +1,56 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_SOURCETOKENINDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_SOURCETOKENINDEX_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/TokenKinds.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace clang {
+class LangOptions;
+class SourceManager;
+} // namespace clang
+
+namespace clang::tidy::autorefactorings {
+
+/// The raw tokens of a file, lexed once without comments, ordered by their
+/// offsets. The token queries of the checks look them up by a binary search
+/// instead of lexing the source again. The comments and the preprocessor
+/// directives met on the way are kept apart from the tokens.
+class SourceTokenIndex {
+public:
+  struct RawToken {
+    unsigned Offset;
+    unsigned Length;
+    tok::TokenKind Kind;
+  };
+
+  SourceTokenIndex(FileID File, const SourceManager &Manager,
+                   const LangOptions &LangOpts);
+
+  /// The token starting at the offset, or null if no token starts there.
+  const RawToken *getTokenAt(unsigned Offset) const;
+
+  /// The token following the one starting at the offset, or null if there
+  /// is none.
+  const RawToken *getTokenAfter(unsigned Offset) const;
+
+  /// Whether the offset is inside a token but not at its start, e.g. in a
+  /// string literal continued on the next line.
+  bool isInsideToken(unsigned Offset) const;
+
+  /// Whether the offset is inside a comment but not at its start.
+  bool isInsideComment(unsigned Offset) const;
+
+  /// Whether a preprocessor directive starts in [Begin, End).
+  bool hasDirective(unsigned Begin, unsigned End) const;
+
+private:
+  llvm::SmallVector<RawToken, 0> Tokens;
+  llvm::SmallVector<RawToken, 0> Comments;
+  // The offsets of the '#' of the directives.
+  llvm::SmallVector<unsigned, 0> Directives;
+};
+
+}; // namespace clang::tidy::autorefactorings
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_AUTOREFACTORINGS_SOURCETOKENINDEX_H
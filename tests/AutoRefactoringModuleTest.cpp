@@ -1,9 +1,15 @@
 #include "ClangTidyTest.h"
 #include "autorefactorings/CallExprInIfChecker.h"
 #include "autorefactorings/CommaInIfChecker.h"
+#include "autorefactorings/FunctionAnalysisManager.h"
 #include "autorefactorings/GoToReturnChecker.h"
 #include "autorefactorings/IfElseReturnChecker.h"
+#include "autorefactorings/SourceLineTable.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
 #include "gtest/gtest.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 
 namespace clang {
 namespace tidy {
@@ -11,8 +17,11 @@ namespace test {
 
 using autorefactorings::CallExpInIfChecker;
 using autorefactorings::CommaInIfChecker;
+using autorefactorings::FunctionAnalysis;
+using autorefactorings::FunctionAnalysisManager;
 using autorefactorings::GoToReturnChecker;
 using autorefactorings::IfElseReturnChecker;
+using autorefactorings::SourceLineTable;
 
 TEST(IfElseReturnCheckerTest, InputAnalyzeMacroExpansion) {
   ClangTidyOptions Opts;
@@ -83,6 +92,40 @@ int main(int argc, char** argv) {
                           PreCode, nullptr, "input.cc", {}, Opts));
 }
 
+TEST(IfElseReturnCheckerTest, ReverseUODeMorgan) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.Indent"] = "2";
+  Opts.CheckOptions["test-check-0.NeedShift"] = "false";
+  Opts.CheckOptions["test-check-0.ReverseOnNotUO"] = "true";
+
+  const char *PreCode = R"(
+int main(int argc, char** argv) {
+  int x;
+  if(!!argc || !(argc < 5)) {
+    x = 2;
+    x = 3;
+  } else {
+    x = 1;
+  }
+  x = 4;
+})";
+
+  const char *PostCode = R"(
+int main(int argc, char** argv) {
+  int x;
+  if(!argc && (argc < 5)) {
+    x = 1;
+  } else {
+    x = 2;
+    x = 3;
+  }
+  x = 4;
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<IfElseReturnChecker>(
+                          PreCode, nullptr, "input.c", {}, Opts));
+}
+
 TEST(IfElseReturnCheckerTest, InputMacroNegateCheck) {
   ClangTidyOptions Opts;
   Opts.CheckOptions["test-check-0.Indent"] = "2";
@@ -272,6 +315,11 @@ int main(int argc, char** argv) {
 
   EXPECT_EQ(PostCode, runCheckOnCode<IfElseReturnChecker>(
                           PreCode, nullptr, "input.cc", {}, Opts1));
+
+  // The lazy reachability analysis gives the same result
+  Opts1.CheckOptions["test-check-0.MaxDenseReachabilityBlocks"] = "0";
+  EXPECT_EQ(PostCode, runCheckOnCode<IfElseReturnChecker>(
+                          PreCode, nullptr, "input.cc", {}, Opts1));
 }
 
 TEST(IfElseReturnCheckerTest, InputSimpleIfElseWithCmnSucc) {
@@ -307,6 +355,39 @@ int main(int argc, char** argv) {
                           PreCode, nullptr, "input.cc", {}, Opts));
 }
 
+TEST(IfElseReturnCheckerTest, MarkerBytesInSource) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.Indent"] = "2";
+  Opts.CheckOptions["test-check-0.NeedShift"] = "false";
+
+  // The bytes the reversals use to refer to the rewritten text are kept as
+  // they are.
+  std::string PreCode = "\n"
+                        "int main(int argc, char** argv) {\n"
+                        "  const char *s;\n"
+                        "  if(argc > 5) {\n"
+                        "    s = \"\x01" "0\x02\";\n"
+                        "    s = \"\x02\";\n"
+                        "  } else {\n"
+                        "    s = \"\x01\"; // \x01\n"
+                        "  }\n"
+                        "}";
+
+  std::string PostCode = "\n"
+                         "int main(int argc, char** argv) {\n"
+                         "  const char *s;\n"
+                         "  if(!(argc > 5)) {\n"
+                         "    s = \"\x01\"; // \x01\n"
+                         "  } else {\n"
+                         "    s = \"\x01" "0\x02\";\n"
+                         "    s = \"\x02\";\n"
+                         "  }\n"
+                         "}";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<IfElseReturnChecker>(
+                          PreCode, nullptr, "input.cc", {}, Opts));
+}
+
 TEST(IfElseReturnCheckerTest, InputSimpleIfElseWithoutElseBrack) {
   ClangTidyOptions Opts;
   Opts.CheckOptions["test-check-0.Indent"] = "2";
@@ -379,6 +460,36 @@ int main(int argc, char** argv) {
                           PreCode, nullptr, "input.cc", {}, Opts));
 }
 
+TEST(IfElseReturnCheckerTest, DeepNestedReversals) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.Indent"] = "2";
+  Opts.CheckOptions["test-check-0.NeedShift"] = "false";
+
+  // Every IfStmt is reversed and holds the reversals of all nested ones, the
+  // texts are built from the innermost one. A few levels are enough to catch
+  // a fragment that is expanded in the wrong order or twice.
+  const int Depth = 50;
+  std::string PreIfs;
+  std::string PostIfs;
+  for (int I = Depth - 1; I >= 0; --I) {
+    std::string Indent(2 * (I + 1), ' ');
+    std::string Inner = Indent + "  ";
+    std::string Condition = "argc > " + std::to_string(I);
+    std::string Then =
+        Inner + "x = " + std::to_string(I) + ";\n" + Inner + "x = 1;\n";
+    PreIfs = Indent + "if (" + Condition + ") {\n" + PreIfs + Then + Indent +
+             "} else {\n" + Inner + "x = 0;\n" + Indent + "}\n";
+    PostIfs = Indent + "if (!(" + Condition + ")) {\n" + Inner + "x = 0;\n" +
+              Indent + "} else {\n" + PostIfs + Then + Indent + "}\n";
+  }
+  std::string Prefix = "\nint main(int argc, char** argv) {\n  int x = 1;\n";
+  std::string PreCode = Prefix + PreIfs + "}";
+  std::string PostCode = Prefix + PostIfs + "}";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<IfElseReturnChecker>(
+                          PreCode, nullptr, "input.cc", {}, Opts));
+}
+
 TEST(GoToReturnCheckerTest, BasicTest) {
   const char *PreCode = R"(
 int lol(int y) {
@@ -416,10 +527,100 @@ int main(int argc, char **argv) {
 		return 123;
 	}
 	return 456;
-LAB1:
 	return 123;
+	return 456;
+})";
+
+  EXPECT_EQ(PostCode,
+            runCheckOnCode<GoToReturnChecker>(PreCode, nullptr, "input.cc", {},
+                                              ClangTidyOptions()));
+}
+
+TEST(GoToReturnCheckerTest, LabelChains) {
+  const char *PreCode = R"(
+int main(int argc, char **argv) {
+	if (argc > 5) {
+		goto LAB1;
+	}
+	if (argc > 3) {
+		goto LAB3;
+	}
+	goto LAB2;
+LAB1:
+	goto LAB2;
 LAB2:
 	return 456;
+LAB3:
+	goto LAB4;
+LAB4:
+	argc = 1;
+	return argc;
+})";
+
+  const char *PostCode = R"(
+int main(int argc, char **argv) {
+	if (argc > 5) {
+		return 456;
+	}
+	if (argc > 3) {
+		goto LAB4;
+	}
+	return 456;
+	return 456;
+	return 456;
+	goto LAB4;
+LAB4:
+	argc = 1;
+	return argc;
+})";
+
+  EXPECT_EQ(PostCode,
+            runCheckOnCode<GoToReturnChecker>(PreCode, nullptr, "input.cc", {},
+                                              ClangTidyOptions()));
+}
+
+TEST(GoToReturnCheckerTest, CommentedLabel) {
+  const char *PreCode = R"(
+int main(int argc, char **argv) {
+	if (argc > 5) {
+		goto LAB1;
+	}
+	return 0;
+LAB1: // retry
+	return 123;
+})";
+
+  const char *PostCode = R"(
+int main(int argc, char **argv) {
+	if (argc > 5) {
+		return 123;
+	}
+	return 0;
+// retry
+	return 123;
+})";
+
+  EXPECT_EQ(PostCode,
+            runCheckOnCode<GoToReturnChecker>(PreCode, nullptr, "input.cc", {},
+                                              ClangTidyOptions()));
+}
+
+TEST(GoToReturnCheckerTest, GotoInCondition) {
+  const char *PreCode = R"(
+int main(int argc, char **argv) {
+	if (({ if (argc > 5) goto LAB1; argc; }))
+		return 0;
+	return 1;
+LAB1:
+	return 123;
+})";
+
+  const char *PostCode = R"(
+int main(int argc, char **argv) {
+	if (({ if (argc > 5) return 123; argc; }))
+		return 0;
+	return 1;
+	return 123;
 })";
 
   EXPECT_EQ(PostCode,
@@ -427,6 +628,77 @@ LAB2:
                                               ClangTidyOptions()));
 }
 
+TEST(GoToReturnCheckerTest, MaxCachedFunctions) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["MaxCachedFunctions"] = "1";
+
+  const char *PreCode = R"(
+int lol(int y) {
+	if (y > 123) {
+		goto LAB3;
+	}
+	goto LAB3;
+LAB3:
+	return 5;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 5) {
+		goto LAB1;
+	}
+	goto LAB2;
+LAB1:
+	return 123;
+LAB2:
+	return 456;
+})";
+
+  const char *PostCode = R"(
+int lol(int y) {
+	if (y > 123) {
+		return 5;
+	}
+	return 5;
+	return 5;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 5) {
+		return 123;
+	}
+	return 456;
+	return 123;
+	return 456;
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<GoToReturnChecker>(PreCode, nullptr,
+                                                        "input.cc", {}, Opts));
+}
+
+TEST(GoToReturnCheckerTest, MaxCFGBlocks) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.MaxCFGBlocks"] = "4";
+
+  const char *PreCode = R"(
+int main(int argc, char **argv) {
+	if (argc > 5) {
+		goto LAB1;
+	}
+	goto LAB2;
+LAB1:
+	return 123;
+LAB2:
+	return 456;
+})";
+
+  std::vector<ClangTidyError> Errors;
+  EXPECT_EQ(PreCode, runCheckOnCode<GoToReturnChecker>(PreCode, &Errors,
+                                                       "input.cc", {}, Opts));
+  ASSERT_EQ(1u, Errors.size());
+  EXPECT_EQ("'main' is skipped because its CFG has more than 4 blocks",
+            Errors[0].Message.Message);
+}
+
 TEST(CallExpInIfCheckerTest, AutoAllCallExpr) {
   ClangTidyOptions Opts;
   Opts.CheckOptions["test-check-0.UseAuto"] = "true";
@@ -501,8 +773,8 @@ int main(int argc, char** argv) {
 	if(x != NULL)
 		*x = 1;
 
-	auto var1 = kek();
-	if (var1) {
+	auto var0 = kek();
+	if (var0) {
 		*x = 2;
 	}
 	
@@ -511,8 +783,8 @@ int main(int argc, char** argv) {
 		*x = 3;
 	}
 	
-	auto var3 = uhuhu();
-	if (var3) {
+	auto var1 = uhuhu();
+	if (var1) {
 		*x = 4;
 	}
 })";
@@ -702,95 +974,612 @@ int main(int argc, char** argv) {
                                                          "input.c", {}, Opts));
 }
 
-TEST(CallExpInIfCheckerTest, InputCompositionCall) {
+TEST(CallExpInIfCheckerTest, IgnoreFilterFile) {
+  SmallString<128> Path;
+  int FD;
+  ASSERT_FALSE(
+      llvm::sys::fs::createTemporaryFile("ignore-filter", "txt", FD, Path));
+  {
+    llvm::raw_fd_ostream Stream(FD, /*shouldClose=*/true);
+    Stream << "# Known library functions\nkek\n\n  uhuhu  \n";
+  }
+
   ClangTidyOptions Opts;
-  Opts.CheckOptions["test-check-0.VariablePrefix"] = "variable";
+  Opts.CheckOptions["test-check-0.IgnoreFilterFile"] = Path.str().str();
 
   const char *PreCode = R"(
-#define NULL                0
-
-int lol() {
-	return 0;
+int kek() {
+	return 5;
 }
 
-int kek(int u) {
-	return 0 + u;
+int lol() {
+	return 6;
 }
 
 int main(int argc, char** argv) {
 	int x;
-	if(kek(lol())) {
+	if (kek()) {
 		x = 1;
 	}
+
+	if (lol()) {
+		x = 2;
+	}
 })";
 
   const char *PostCode = R"(
-#define NULL                0
-
-int lol() {
-	return 0;
+int kek() {
+	return 5;
 }
 
-int kek(int u) {
-	return 0 + u;
+int lol() {
+	return 6;
 }
 
 int main(int argc, char** argv) {
 	int x;
-	int variable0 = kek(lol());
-	if(variable0) {
+	if (kek()) {
 		x = 1;
 	}
+
+	int var0 = lol();
+	if (var0) {
+		x = 2;
+	}
 })";
 
   EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
                                                          "input.c", {}, Opts));
+  llvm::sys::fs::remove(Path);
 }
 
-TEST(CommaInIfCheckerTest, BasicTest) {
+TEST(CallExpInIfCheckerTest, FilterFile) {
+  SmallString<128> Path;
+  int FD;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("filter", "txt", FD, Path));
+  {
+    llvm::raw_fd_ostream Stream(FD, /*shouldClose=*/true);
+    Stream << "# Functions to extract\nkek\n";
+  }
+
   ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.FilterFile"] = Path.str().str();
 
   const char *PreCode = R"(
-int lol() {
+int kek() {
 	return 5;
 }
 
-int main(int argc, char **argv) {
+int lol() {
+	return 6;
+}
+
+int main(int argc, char** argv) {
 	int x;
-	if((x = 5, x < 10)) {
-		x = 1;
-	}
-	
-	int y;
-	int z;
-	if(x = 6, y = 5, (x + y) < 10) {
-		x = 1;
-	}
-	
-	if((z = 7, x = 6, y = 5, (x + y) - z < 10))
-		x = 1;
-		
-	if((x = lol(), y = 5, (x + y) < 10)) {
+	if (kek()) {
 		x = 1;
 	}
-	
-	int u;
-	int t;
-	if((x = lol(), y = 5, (x + y) < 10)
-		&& (u = 4, t = 228, (u - t) < 0)) {
-		x = 1;
+
+	if (lol()) {
+		x = 2;
 	}
 })";
 
   const char *PostCode = R"(
-int lol() {
+int kek() {
 	return 5;
 }
 
-int main(int argc, char **argv) {
-	int x;
-	x = 5;
-	if((x < 10)) {
+int lol() {
+	return 6;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	int var0 = kek();
+	if (var0) {
+		x = 1;
+	}
+
+	if (lol()) {
+		x = 2;
+	}
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
+                                                         "input.c", {}, Opts));
+  llvm::sys::fs::remove(Path);
+}
+
+TEST(CallExpInIfCheckerTest, FiltersPerInstance) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.Filter"] = "^kek$";
+  Opts.CheckOptions["test-check-0.VariablePrefix"] = "a";
+  Opts.CheckOptions["test-check-1.Filter"] = "^lol$";
+  Opts.CheckOptions["test-check-1.VariablePrefix"] = "b";
+
+  const char *PreCode = R"(
+int kek() {
+	return 5;
+}
+
+int lol() {
+	return 6;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	if (kek()) {
+		x = 1;
+	}
+
+	if (lol()) {
+		x = 2;
+	}
+})";
+
+  const char *PostCode = R"(
+int kek() {
+	return 5;
+}
+
+int lol() {
+	return 6;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	int a0 = kek();
+	if (a0) {
+		x = 1;
+	}
+
+	int b0 = lol();
+	if (b0) {
+		x = 2;
+	}
+})";
+
+  EXPECT_EQ(PostCode,
+            (runCheckOnCode<CallExpInIfChecker, CallExpInIfChecker>(
+                PreCode, nullptr, "input.c", {}, Opts)));
+}
+
+TEST(CallExpInIfCheckerTest, InvalidFilter) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.Filter"] = "(kek";
+
+  const char *PreCode = R"(
+int kek() {
+	return 5;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	if (kek()) {
+		x = 1;
+	}
+})";
+
+  std::vector<ClangTidyError> Errors;
+  EXPECT_EQ(PreCode, runCheckOnCode<CallExpInIfChecker>(PreCode, &Errors,
+                                                        "input.c", {}, Opts));
+  ASSERT_EQ(1u, Errors.size());
+  EXPECT_TRUE(StringRef(Errors[0].Message.Message)
+                  .starts_with("invalid regular expression '(kek' for "
+                               "option 'Filter'"));
+}
+
+TEST(CallExpInIfCheckerTest, InputCompositionCall) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.VariablePrefix"] = "variable";
+
+  const char *PreCode = R"(
+#define NULL                0
+
+int lol() {
+	return 0;
+}
+
+int kek(int u) {
+	return 0 + u;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	if(kek(lol())) {
+		x = 1;
+	}
+})";
+
+  const char *PostCode = R"(
+#define NULL                0
+
+int lol() {
+	return 0;
+}
+
+int kek(int u) {
+	return 0 + u;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	int variable0 = kek(lol());
+	if(variable0) {
+		x = 1;
+	}
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
+                                                         "input.c", {}, Opts));
+}
+
+TEST(CallExpInIfCheckerTest, MultipleCalls) {
+  ClangTidyOptions Opts;
+
+  const char *PreCode = R"(
+int lol() {
+	return 0;
+}
+
+int kek(int u) {
+	return 0 + u;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	if(kek(lol()) == lol() + kek(sizeof(lol())) && lol()) {
+		x = 1;
+	}
+})";
+
+  const char *PostCode = R"(
+int lol() {
+	return 0;
+}
+
+int kek(int u) {
+	return 0 + u;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	int var0 = kek(lol());
+	int var1 = lol();
+	int var2 = kek(sizeof(lol()));
+	if(var0 == var1 + var2 && lol()) {
+		x = 1;
+	}
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
+                                                         "input.c", {}, Opts));
+}
+
+TEST(CallExpInIfCheckerTest, CallsInElseIf) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.VariablePrefix"] = "variable";
+
+  const char *PreCode = R"(
+int lol() {
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	if(lol()) {
+		x = 1;
+	}
+	if(lol() && lol()) {
+		x = 2;
+	} else if (lol()) {
+		x = 3;
+	}
+})";
+
+  const char *PostCode = R"(
+int lol() {
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	int variable0 = lol();
+	if(variable0) {
+		x = 1;
+	}
+	int variable1 = lol();
+	if(variable1 && lol()) {
+		x = 2;
+	} else {
+		int variable2 = lol();
+		if (variable2) {
+			x = 3;
+		}
+	}
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
+                                                         "input.c", {}, Opts));
+}
+
+TEST(CallExpInIfCheckerTest, VariableNamesPerFunction) {
+  ClangTidyOptions Opts;
+
+  const char *PreCode = R"(
+int lol() {
+	return 0;
+}
+
+void foo(int var0) {
+	if(lol()) {
+		var0 = 1;
+	}
+}
+
+int main(int argc, char** argv) {
+	int x;
+	if(lol()) {
+		x = 1;
+	}
+})";
+
+  const char *PostCode = R"(
+int lol() {
+	return 0;
+}
+
+void foo(int var0) {
+	int var1 = lol();
+	if(var1) {
+		var0 = 1;
+	}
+}
+
+int main(int argc, char** argv) {
+	int x;
+	int var0 = lol();
+	if(var0) {
+		x = 1;
+	}
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
+                                                         "input.c", {}, Opts));
+}
+
+TEST(CallExpInIfCheckerTest, TypeAndMacroNames) {
+  ClangTidyOptions Opts;
+
+  const char *PreCode = R"(
+typedef int var0;
+#define var1 1
+
+int g() {
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	if(g()) {
+		var0 y = var1;
+		return y;
+	}
+	return 0;
+})";
+
+  const char *PostCode = R"(
+typedef int var0;
+#define var1 1
+
+int g() {
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	int var2 = g();
+	if(var2) {
+		var0 y = var1;
+		return y;
+	}
+	return 0;
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
+                                                         "input.c", {}, Opts));
+}
+
+TEST(CallExpInIfCheckerTest, SeveralFunctions) {
+  ClangTidyOptions Opts;
+
+  const char *PreCode = R"(
+int lol() {
+	return 0;
+}
+
+int foo(int y) {
+	if(y > 1) {
+		y = 1;
+	} else if (lol()) {
+		y = 2;
+	}
+	return y;
+}
+
+void bar(int z) {
+	z = lol();
+}
+
+int main(int argc, char** argv) {
+	int x;
+	if(lol()) {
+		x = 1;
+	}
+	if(x) {
+		if(lol()) {
+			x = 2;
+		}
+	}
+	return foo(x);
+})";
+
+  const char *PostCode = R"(
+int lol() {
+	return 0;
+}
+
+int foo(int y) {
+	if(y > 1) {
+		y = 1;
+	} else {
+		int var0 = lol();
+		if (var0) {
+			y = 2;
+		}
+	}
+	return y;
+}
+
+void bar(int z) {
+	z = lol();
+}
+
+int main(int argc, char** argv) {
+	int x;
+	int var0 = lol();
+	if(var0) {
+		x = 1;
+	}
+	if(x) {
+		int var1 = lol();
+		if(var1) {
+			x = 2;
+		}
+	}
+	return foo(x);
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
+                                                         "input.c", {}, Opts));
+}
+
+TEST(CallExpInIfCheckerTest, DirectiveInElseIfChain) {
+  ClangTidyOptions Opts;
+
+  // The braces of the new blocks would cross the conditional region.
+  const char *Code = R"(
+int lol() {
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int x;
+	if(argc > 1) {
+		x = 1;
+	} else if (lol()) {
+#if 0
+		x = 2;
+#endif
+		x = 3;
+	}
+})";
+
+  EXPECT_EQ(Code, runCheckOnCode<CallExpInIfChecker>(Code, nullptr, "input.c",
+                                                     {}, Opts));
+}
+
+TEST(CallExpInIfCheckerTest, DeepElseIfChain) {
+  ClangTidyOptions Opts;
+
+  // None of the conditions of the chain has calls, so nothing is changed.
+  std::string Code = "int lol() {\n\treturn 0;\n}\n\nint main() {\n"
+                     "\tint x = 0;\n";
+  for (int I = 0; I < 50; ++I) {
+    Code += "\tif (x == " + std::to_string(I) + ") x = lol();\n\telse";
+  }
+  Code += " x = 0;\n\treturn x;\n}\n";
+
+  EXPECT_EQ(Code, runCheckOnCode<CallExpInIfChecker>(Code, nullptr, "input.c",
+                                                     {}, Opts));
+}
+
+TEST(CallExpInIfCheckerTest, DeepElseIfChainWithCalls) {
+  ClangTidyOptions Opts;
+
+  // Every "else if" with a call is enclosed in the block of the previous one.
+  const int Depth = 50;
+  std::string Prefix = "int lol() {\n\treturn 0;\n}\n\nint main() {\n"
+                       "\tint x = 0;\n";
+  std::string PreCode = Prefix + "\tif (lol() == 0) {\n\t\tx = 0;\n";
+  std::string PostCode =
+      Prefix + "\tint var0 = lol();\n\tif (var0 == 0) {\n\t\tx = 0;\n";
+  for (int I = 1; I < Depth; ++I) {
+    auto Number = std::to_string(I);
+    std::string Indent(I + 1, '\t');
+    PreCode += "\t} else if (lol() == " + Number + ") {\n\t\tx = " + Number +
+               ";\n";
+    PostCode += std::string(I, '\t') + "} else {\n" + Indent + "int var" +
+                Number + " = lol();\n" + Indent + "if (var" + Number +
+                " == " + Number + ") {\n" + Indent + "\tx = " + Number +
+                ";\n";
+  }
+  PreCode += "\t} else {\n\t\tx = -1;\n\t}\n\treturn x;\n}\n";
+  PostCode += std::string(Depth, '\t') + "} else {\n" +
+              std::string(Depth + 1, '\t') + "x = -1;\n" +
+              std::string(Depth, '\t') + "}";
+  for (int I = Depth - 1; I >= 1; --I) {
+    PostCode += "\n" + std::string(I, '\t') + "}";
+  }
+  PostCode += "\n\treturn x;\n}\n";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CallExpInIfChecker>(PreCode, nullptr,
+                                                         "input.c", {}, Opts));
+}
+
+TEST(CommaInIfCheckerTest, BasicTest) {
+  ClangTidyOptions Opts;
+
+  const char *PreCode = R"(
+int lol() {
+	return 5;
+}
+
+int main(int argc, char **argv) {
+	int x;
+	if((x = 5, x < 10)) {
+		x = 1;
+	}
+	
+	int y;
+	int z;
+	if(x = 6, y = 5, (x + y) < 10) {
+		x = 1;
+	}
+	
+	if((z = 7, x = 6, y = 5, (x + y) - z < 10))
+		x = 1;
+		
+	if((x = lol(), y = 5, (x + y) < 10)) {
+		x = 1;
+	}
+	
+	int u;
+	int t;
+	if((x = lol(), y = 5, (x + y) < 10)
+		&& (u = 4, t = 228, (u - t) < 0)) {
+		x = 1;
+	}
+})";
+
+  const char *PostCode = R"(
+int lol() {
+	return 5;
+}
+
+int main(int argc, char **argv) {
+	int x;
+	x = 5;
+	if((x < 10)) {
 		x = 1;
 	}
 	
@@ -826,6 +1615,183 @@ int main(int argc, char **argv) {
                                                        "input.c", {}, Opts));
 }
 
+TEST(CommaInIfCheckerTest, NestedComma) {
+  ClangTidyOptions Opts;
+
+  const char *PreCode = R"(
+int main(int argc, char **argv) {
+	int x;
+	int y;
+	if((x = 5, (y = 6, x < y))) {
+		x = 1;
+	}
+
+	if(x = 6, (y = 5, x), !(y = 4, y < 0)) {
+		x = 1;
+	}
+})";
+
+  const char *PostCode = R"(
+int main(int argc, char **argv) {
+	int x;
+	int y;
+	x = 5;
+	y = 6;
+	if((x < y)) {
+		x = 1;
+	}
+
+	x = 6;
+	y = 5;
+	x;
+	y = 4;
+	if(!(y < 0)) {
+		x = 1;
+	}
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CommaInIfChecker>(PreCode, nullptr,
+                                                       "input.c", {}, Opts));
+}
+
+TEST(CommaInIfCheckerTest, ElseIfChain) {
+  ClangTidyOptions Opts;
+
+  const char *PreCode = R"(
+int main(int argc, char **argv) {
+	int x;
+	int y;
+	if(x = 6, x < 0) {
+		x = 1;
+	} else if (y = 5, y < 0) {
+		x = 2;
+	} else if (x > y) {
+		x = 3;
+	} else if (y = 4, x < y) {
+		x = 4;
+	}
+})";
+
+  const char *PostCode = R"(
+int main(int argc, char **argv) {
+	int x;
+	int y;
+	x = 6;
+	if(x < 0) {
+		x = 1;
+	} else {
+		y = 5;
+		if (y < 0) {
+			x = 2;
+		} else if (x > y) {
+			x = 3;
+		} else {
+			y = 4;
+			if (x < y) {
+				x = 4;
+			}
+		}
+	}
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CommaInIfChecker>(PreCode, nullptr,
+                                                       "input.c", {}, Opts));
+}
+
+TEST(CommaInIfCheckerTest, FusedTraversal) {
+  ClangTidyOptions Opts;
+  Opts.CheckOptions["test-check-0.FusedTraversal"] = "true";
+
+  const char *PreCode = R"(
+int main(int argc, char **argv) {
+	int x;
+	int y;
+	if((x = 5, x < 10)) {
+		x = 1;
+	}
+
+	if(x = 6, y = 5, (x + y) < 10) {
+		x = 1;
+	}
+
+	if((x = 6, y = 5, (x + y) < 10) && (y = 4, y < 0)) {
+		x = 1;
+	}
+})";
+
+  const char *PostCode = R"(
+int main(int argc, char **argv) {
+	int x;
+	int y;
+	x = 5;
+	if((x < 10)) {
+		x = 1;
+	}
+
+	x = 6;
+	y = 5;
+	if((x + y) < 10) {
+		x = 1;
+	}
+
+	if((x = 6, y = 5, (x + y) < 10) && (y = 4, y < 0)) {
+		x = 1;
+	}
+})";
+
+  EXPECT_EQ(PostCode, runCheckOnCode<CommaInIfChecker>(PreCode, nullptr,
+                                                       "input.c", {}, Opts));
+}
+
+TEST(FunctionAnalysisManagerTest, MaxCachedFunctions) {
+  auto AST = tooling::buildASTFromCode(R"(
+int f0(void) { return 0; }
+int f1(void) { return 1; }
+int f2(void) { return 2; }
+)",
+                                       "input.c");
+  ASSERT_TRUE(AST);
+  auto &Context = AST->getASTContext();
+  SmallVector<const FunctionDecl *, 3> Functions;
+  for (const auto *Decl : Context.getTranslationUnitDecl()->decls()) {
+    if (const auto *Function = dyn_cast<FunctionDecl>(Decl)) {
+      Functions.push_back(Function);
+    }
+  }
+  ASSERT_EQ(3u, Functions.size());
+
+  ClangTidyOptions::OptionMap CheckOptions;
+  CheckOptions["MaxCachedFunctions"] = "2";
+  FunctionAnalysisManager Manager(CheckOptions);
+  Manager.getAnalysis(Functions[0], Context);
+  FunctionAnalysis *Second = &Manager.getAnalysis(Functions[1], Context);
+  FunctionAnalysis *Third = &Manager.getAnalysis(Functions[2], Context);
+
+  // The oldest analysis is evicted, the newer ones are kept.
+  EXPECT_EQ(2u, Manager.getNumCachedAnalyses());
+  EXPECT_EQ(Second, &Manager.getAnalysis(Functions[1], Context));
+  EXPECT_EQ(Third, &Manager.getAnalysis(Functions[2], Context));
+  EXPECT_EQ(2u, Manager.getNumCachedAnalyses());
+
+  // Requesting the evicted function again rebuilds its analysis in place of
+  // the oldest remaining one.
+  EXPECT_EQ(Functions[0],
+            Manager.getAnalysis(Functions[0], Context).getFunction());
+  EXPECT_EQ(2u, Manager.getNumCachedAnalyses());
+  EXPECT_EQ(Third, &Manager.getAnalysis(Functions[2], Context));
+}
+
+TEST(SourceLineTableTest, LineBreaks) {
+  // Only "\r\n" is a single line break, like in the SourceManager.
+  SourceLineTable Table("a\n\rb\r\nc\rd");
+  EXPECT_EQ(1u, Table.getLineNumber(0));
+  EXPECT_EQ(2u, Table.getLineNumber(2));
+  EXPECT_EQ(3u, Table.getLineNumber(3));
+  EXPECT_EQ(4u, Table.getLineNumber(6));
+  EXPECT_EQ(5u, Table.getLineNumber(8));
+  EXPECT_EQ(6u, Table.getLineStart(4));
+}
+
 } // namespace test
 } // namespace tidy
 } // namespace clang
@@ -14,8 +14,6 @@ int main(int argc, char **argv) {
 		return 123;
 	}
 	return 456;
-LAB1:
 	return 123;
-LAB2:
 	return 456;
 }
@@ -9,7 +9,8 @@ int kek(int u) {
 }
 
 int main(int argc, char** argv) {
-	if(lol() && kek(lol())) {
+	int variable0 = lol();
+	if(variable0 && kek(lol())) {
 		printf("%d", 1);
 	}
 }
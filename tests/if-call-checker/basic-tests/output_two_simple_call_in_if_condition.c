@@ -5,7 +5,8 @@ int lol() {
 }
 
 int main(int argc, char** argv) {
-	if(lol() && lol()) {
+	int variable0 = lol();
+	if(variable0 && lol()) {
 		printf("%d", 1);
 	}
 }
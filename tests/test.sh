@@ -19,11 +19,6 @@ do
   "$CLANG_TIDY_EXECUTABLE" --config-file="$CLANG_TIDY_CONFIG_DIR/.clang-tidy" --fix "$i"
   OUTPUT_FILE="${i/input/output}"
   
-  if [ -f "$CLANG_TIDY_CONFIG_DIR/.post-clang-tidy" ]; then
-   echo "Proccess .post-clang-tidy"
-   "$CLANG_TIDY_EXECUTABLE" --config-file="$CLANG_TIDY_CONFIG_DIR/.post-clang-tidy" --fix "$i"
-  fi
-  
   if cmp -s "$i" "$OUTPUT_FILE"; then
     echo "Test for file "$i" with config $CLANG_TIDY_CONFIG_DIR/.clang-tidy passed"
   else